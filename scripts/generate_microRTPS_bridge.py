@@ -330,6 +330,7 @@ check_rtps_id_uniqueness(classifier)
 uRTPS_CLIENT_TEMPL_FILE = 'microRTPS_client.cpp.em'
 uRTPS_AGENT_TOPICS_H_TEMPL_FILE = 'RtpsTopics.h.em'
 uRTPS_AGENT_TOPICS_SRC_TEMPL_FILE = 'RtpsTopics.cpp.em'
+uRTPS_AGENT_TOPIC_LAYOUT_H_TEMPL_FILE = 'microRTPS_topic_layout.h.em'
 uRTPS_AGENT_TEMPL_FILE = 'microRTPS_agent.cpp.em'
 uRTPS_TIMESYNC_CPP_TEMPL_FILE = 'microRTPS_timesync.cpp.em'
 uRTPS_TIMESYNC_H_TEMPL_FILE = 'microRTPS_timesync.h.em'
@@ -413,6 +414,8 @@ def generate_agent(out_dir):
                                                         urtps_templates_dir, package, px_generate_uorb_topic_files.INCL_DEFAULT, classifier.msg_id_map, fastrtps_version, ros2_distro, uRTPS_AGENT_TOPICS_H_TEMPL_FILE)
     px_generate_uorb_topic_files.generate_uRTPS_general(classifier.msgs_to_send, classifier.alias_msgs_to_send, classifier.msgs_to_receive, classifier.alias_msgs_to_receive, msg_dir, out_dir,
                                                         urtps_templates_dir, package, px_generate_uorb_topic_files.INCL_DEFAULT, classifier.msg_id_map, fastrtps_version, ros2_distro, uRTPS_AGENT_TOPICS_SRC_TEMPL_FILE)
+    px_generate_uorb_topic_files.generate_uRTPS_general(classifier.msgs_to_send, classifier.alias_msgs_to_send, classifier.msgs_to_receive, classifier.alias_msgs_to_receive, msg_dir, out_dir,
+                                                        urtps_templates_dir, package, px_generate_uorb_topic_files.INCL_DEFAULT, classifier.msg_id_map, fastrtps_version, ros2_distro, uRTPS_AGENT_TOPIC_LAYOUT_H_TEMPL_FILE)
     if cmakelists:
         px_generate_uorb_topic_files.generate_uRTPS_general(classifier.msgs_to_send, classifier.alias_msgs_to_send, classifier.msgs_to_receive, classifier.alias_msgs_to_receive, msg_dir, os.path.dirname(out_dir),
                                                             urtps_templates_dir, package, px_generate_uorb_topic_files.INCL_DEFAULT, classifier.msg_id_map, fastrtps_version, ros2_distro, uRTPS_AGENT_CMAKELISTS_TEMPL_FILE)
@@ -449,6 +452,14 @@ def generate_agent(out_dir):
         shutil.rmtree(os.path.join(out_dir, "fastrtpsgen"))
     cp_wildcard(os.path.join(urtps_templates_dir,
                              "microRTPS_transport.*"), agent_out_dir)
+    cp_wildcard(os.path.join(urtps_templates_dir,
+                             "microRTPS_send_queue.h"), agent_out_dir)
+    cp_wildcard(os.path.join(urtps_templates_dir,
+                             "microRTPS_raw_type.h"), agent_out_dir)
+    cp_wildcard(os.path.join(urtps_templates_dir,
+                             "microRTPS_pipeline.h"), agent_out_dir)
+    cp_wildcard(os.path.join(urtps_templates_dir,
+                             "microRTPS_stats.h"), agent_out_dir)
     if cmakelists:
         os.rename(os.path.join(os.path.dirname(out_dir), "microRTPS_agent_CMakeLists.txt"),
                   os.path.join(os.path.dirname(out_dir), "CMakeLists.txt"))
@@ -204,6 +204,64 @@ def add_padding_bytes(fields, search_path):
     return (struct_size, num_padding_bytes)
 
 
+def cdr_align(offset, size):
+    """
+    Align a CDR stream offset to a primitive of the given size
+    """
+    return (offset + size - 1) // size * size
+
+
+def cdr_field_span(field, offset, search_path):
+    """
+    Get the (start, end) offsets of a field serialized at the given CDR stream
+    offset, or None if the field has no fixed size (strings, sequences)
+    """
+    count = 1
+    if field.is_array:
+        if field.array_len is None:
+            return None
+        count = field.array_len
+
+    if field.is_builtin:
+        size = msgtype_size_map.get(bare_name(field.type))
+        if size is None:
+            return None
+        start = cdr_align(offset, size)
+        return (start, start + size * count)
+
+    # embedded type: CDR aligns each of its members, not the struct itself
+    start = None
+    children_fields = get_children_fields(field.base_type, search_path)
+    for i in range(count):
+        for child in children_fields:
+            span = cdr_field_span(child, offset, search_path)
+            if span is None:
+                return None
+            if start is None:
+                start = span[0]
+            offset = span[1]
+    return (offset if start is None else start, offset)
+
+
+def cdr_msg_layout(spec, search_path):
+    """
+    Get the CDR layout of a msg: a dict with the byte offsets of its top level
+    fields, up to the first field that has no fixed size, and its serialized
+    size, or None if the msg has no fixed size
+    """
+    offsets = {}
+    offset = 0
+    for field in spec.parsed_fields():
+        if field.is_header:
+            continue
+        span = cdr_field_span(field, offset, search_path)
+        if span is None:
+            return (offsets, None)
+        offsets[field.name] = span[0]
+        offset = span[1]
+    return (offsets, offset)
+
+
 def convert_type(spec_type):
     """
     Convert from msg type to C type
@@ -409,3 +467,39 @@ def rtps_message_id(msg_id_map, message):
     raise AssertionError(
         "%s %s Please add an ID from the available pool:\n" % (message, error_msg) +
         ", ".join('%d' % id for id in check_available_ids(used_ids)))
+
+
+# Values accepted by the QoS settings of the RTPS IDs file. 'depth' takes a positive integer
+RTPS_QOS_SETTINGS = {
+    'reliability': ('reliable', 'best_effort'),
+    'durability': ('volatile', 'transient_local'),
+    'history': ('keep_last', 'keep_all'),
+    'publish_mode': ('sync', 'async'),
+}
+
+
+def rtps_message_qos(msg_id_map, message):
+    """
+    Get the QoS settings of uORB message, from its optional 'qos' entry in
+    the RTPS IDs file. Settings left out keep the Fast-RTPS defaults
+    """
+    if isinstance(msg_id_map, list):
+        msg_id_map = msg_id_map[0]
+
+    for dict in msg_id_map['rtps']:
+        if dict['msg'] == message:
+            qos = dict.get('qos') or {}
+            for setting, value in qos.items():
+                if setting == 'depth':
+                    if not isinstance(value, int) or value < 1:
+                        raise AssertionError(
+                            "%s QoS depth must be a positive integer, got '%s'" % (message, value))
+                elif setting not in RTPS_QOS_SETTINGS:
+                    raise AssertionError("%s has an unknown QoS setting '%s'. Available: %s" % (
+                        message, setting, ", ".join(list(RTPS_QOS_SETTINGS.keys()) + ['depth'])))
+                elif value not in RTPS_QOS_SETTINGS[setting]:
+                    raise AssertionError("%s QoS %s must be one of: %s" % (
+                        message, setting, ", ".join(RTPS_QOS_SETTINGS[setting])))
+            return qos
+
+    return {}
@@ -17,6 +17,7 @@ import genmsg.msgs
 from px_generate_uorb_topic_helper import * # this is in Tools/
 
 topic = alias if alias else spec.short_name
+qos = rtps_message_qos(ids, topic)
 try:
     ros2_distro = ros2_distro.decode("utf-8")
 except AttributeError:
@@ -74,40 +75,60 @@ except AttributeError:
 
 @(topic)_Publisher::@(topic)_Publisher()
     : mp_participant(nullptr),
-      mp_publisher(nullptr)
+      mp_publisher(nullptr),
+      m_passthrough(false)
 { }
 
 @(topic)_Publisher::~@(topic)_Publisher()
 {
-    Domain::removeParticipant(mp_participant);
+    // Removed by RtpsTopics before the participant, which is shared with the other topics
+    remove();
 }
 
-bool @(topic)_Publisher::init(const std::string& ns)
+void @(topic)_Publisher::remove()
 {
-    // Create RTPSParticipant
-    ParticipantAttributes PParam;
-@[if version.parse(fastrtps_version) < version.parse('2.0')]@
-    PParam.rtps.builtin.domainId = 0;
-@[else]@
-    PParam.domainId = 0;
-@[end if]@
-@[if version.parse(fastrtps_version) <= version.parse('1.8.4')]@
-    PParam.rtps.builtin.leaseDuration = c_TimeInfinite;
-@[else]@
-    PParam.rtps.builtin.discovery_config.leaseDuration = c_TimeInfinite;
-@[end if]@
-    std::string nodeName = ns;
-    nodeName.append("@(topic)_publisher");
-    PParam.rtps.setName(nodeName.c_str());
-    mp_participant = Domain::createParticipant(PParam);
+    if (mp_publisher != nullptr) {
+        Domain::removePublisher(mp_publisher);
+        mp_publisher = nullptr;
+    }
+}
+
+void @(topic)_Publisher::unregisterType()
+{
+    TopicDataType* registered_type = nullptr;
+    if (mp_participant != nullptr &&
+        Domain::getRegisteredType(mp_participant, @(topic)DataType.getName(), &registered_type) &&
+        (registered_type == &@(topic)DataType || registered_type == &@(topic)RawDataType)) {
+        Domain::unregisterType(mp_participant, @(topic)DataType.getName());
+    }
+    mp_participant = nullptr;
+}
+
+bool @(topic)_Publisher::init(Participant* participant, const std::string& ns, bool passthrough)
+{
+    m_passthrough = passthrough;
+    mp_participant = participant;
     if(mp_participant == nullptr)
         return false;
 
-    // Register the type
-    Domain::registerType(mp_participant, static_cast<TopicDataType*>(&@(topic)DataType));
+    // Register the type, unless the participant already has it from the subscriber of the same topic or from the
+    // publisher of another link sharing the participant. In passthrough mode, samples are written already
+    // serialized, which needs the raw type registered. Otherwise follow the kind of the registered type, which may
+    // be another link's instance: a sample written through the wrong kind is read as the wrong struct
+    TopicDataType* registered_type = nullptr;
+    if (!Domain::getRegisteredType(mp_participant, @(topic)DataType.getName(), &registered_type)) {
+        if (m_passthrough) {
+            Domain::registerType(mp_participant, static_cast<TopicDataType*>(&@(topic)RawDataType));
+        } else {
+            Domain::registerType(mp_participant, static_cast<TopicDataType*>(&@(topic)DataType));
+        }
+    } else {
+        m_passthrough = (dynamic_cast<RawPubSubType<@(topic)_msg_datatype>*>(registered_type) != nullptr);
+    }
 
-    // Create Publisher
+    // Create Publisher, from the default publisher profile of the Fast-RTPS XML profiles file if one is loaded
     PublisherAttributes Wparam;
+    Domain::getDefaultPublisherAttributes(Wparam);
     Wparam.topic.topicKind = NO_KEY;
     Wparam.topic.topicDataType = @(topic)DataType.getName();
 @[if ros2_distro]@
@@ -126,6 +147,25 @@ bool @(topic)_Publisher::init(const std::string& ns)
     std::string topicName = ns;
     topicName.append("@(topic)PubSubTopic");
     Wparam.topic.topicName = topicName;
+@[end if]@
+@[if qos]@
+
+    // QoS set for the topic in the RTPS IDs file
+@[end if]@
+@[if 'reliability' in qos]@
+    Wparam.qos.m_reliability.kind = @('BEST_EFFORT_RELIABILITY_QOS' if qos['reliability'] == 'best_effort' else 'RELIABLE_RELIABILITY_QOS');
+@[end if]@
+@[if 'durability' in qos]@
+    Wparam.qos.m_durability.kind = @('TRANSIENT_LOCAL_DURABILITY_QOS' if qos['durability'] == 'transient_local' else 'VOLATILE_DURABILITY_QOS');
+@[end if]@
+@[if 'history' in qos]@
+    Wparam.topic.historyQos.kind = @('KEEP_ALL_HISTORY_QOS' if qos['history'] == 'keep_all' else 'KEEP_LAST_HISTORY_QOS');
+@[end if]@
+@[if 'depth' in qos]@
+    Wparam.topic.historyQos.depth = @(qos['depth']);
+@[end if]@
+@[if 'publish_mode' in qos]@
+    Wparam.qos.m_publishMode.kind = @('ASYNCHRONOUS_PUBLISH_MODE' if qos['publish_mode'] == 'async' else 'SYNCHRONOUS_PUBLISH_MODE');
 @[end if]@
     mp_publisher = Domain::createPublisher(mp_participant, Wparam, static_cast<PublisherListener*>(&m_listener));
     if(mp_publisher == nullptr)
@@ -161,3 +201,9 @@ void @(topic)_Publisher::publish(@(topic)_msg_t* st)
 {
     mp_publisher->write(st);
 }
+
+void @(topic)_Publisher::publish(const char* data, uint32_t length)
+{
+    RawSample sample{data, length};
+    mp_publisher->write(&sample);
+}
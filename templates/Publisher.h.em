@@ -75,6 +75,8 @@ except AttributeError:
 #include "@(topic)PubSubTypes.h"
 @[end if]@
 
+#include "microRTPS_raw_type.h"
+
 using namespace eprosima::fastrtps;
 using namespace eprosima::fastrtps::rtps;
 
@@ -101,12 +103,20 @@ class @(topic)_Publisher
 public:
     @(topic)_Publisher();
     virtual ~@(topic)_Publisher();
-    bool init(const std::string& ns);
+    bool init(Participant* participant, const std::string& ns, bool passthrough = false);
     void run();
     void publish(@(topic)_msg_t* st);
+    void publish(const char* data, uint32_t length);
+    bool isPassthrough() const { return m_passthrough; }
+    /** Removes the publisher from DDS. Before the participant goes, which would otherwise remove it **/
+    void remove();
+    /** Unregisters the topic type from the participant if registered by this instance, since the participant refers
+        to it. Once no endpoint of the topic is left on the participant **/
+    void unregisterType();
 private:
-    Participant *mp_participant;
+    Participant *mp_participant; // Shared, owned by RtpsTopics
     Publisher *mp_publisher;
+    bool m_passthrough;
 
     class PubListener : public PublisherListener
     {
@@ -117,6 +127,7 @@ private:
         int n_matched;
     } m_listener;
     @(topic)_msg_datatype @(topic)DataType;
+    RawPubSubType<@(topic)_msg_datatype> @(topic)RawDataType;
 };
 
 #endif // _@(topic)__PUBLISHER_H_
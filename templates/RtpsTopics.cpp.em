@@ -11,6 +11,7 @@
 @###############################################
 @{
 import os
+from packaging import version
 
 import genmsg.msgs
 
@@ -20,6 +21,14 @@ from px_generate_uorb_topic_files import MsgScope # this is in Tools/
 send_topics = [(alias[idx] if alias[idx] else s.short_name) for idx, s in enumerate(spec) if scope[idx] == MsgScope.SEND]
 recv_topics = [(alias[idx] if alias[idx] else s.short_name) for idx, s in enumerate(spec) if scope[idx] == MsgScope.RECEIVE]
 package = package[0]
+fastrtps_version = fastrtps_version[0]
+all_topics = list(dict.fromkeys(send_topics + recv_topics))
+
+# Topics that can be published without decoding them: their timestamp is at a fixed CDR offset
+passthrough_topics = [(alias[idx] if alias[idx] else s.short_name) for idx, s in enumerate(spec)
+                      if scope[idx] == MsgScope.SEND and s.short_name.lower() != 'timesync'
+                      and (alias[idx] if alias[idx] else s.short_name) not in recv_topics
+                      and 'timestamp' in cdr_msg_layout(s, search_path[idx])[0]]
 }@
 /****************************************************************************
  *
@@ -54,15 +63,104 @@ package = package[0]
  *
  ****************************************************************************/
 
+#include <fastrtps/participant/Participant.h>
+#include <fastrtps/attributes/ParticipantAttributes.h>
+#include <fastrtps/Domain.h>
+
+#include <cctype>
+
 #include "RtpsTopics.h"
 
-bool RtpsTopics::init(std::condition_variable* t_send_queue_cv, std::mutex* t_send_queue_mutex, std::queue<uint8_t>* t_send_queue, const std::string& ns)
+RtpsTopics::~RtpsTopics()
+{
+    // Normally done already over every instance, see removeEndpoints()
+    removeEndpoints();
+    removeTopics();
+    removeParticipants();
+}
+
+void RtpsTopics::removeEndpoints()
+{
+@[for topic in send_topics]@
+    _@(topic)_pub.remove();
+@[end for]@
+@[for topic in recv_topics]@
+    _@(topic)_sub.remove();
+@[end for]@
+}
+
+void RtpsTopics::removeTopics()
+{
+@[for topic in send_topics]@
+    _@(topic)_pub.unregisterType();
+@[end for]@
+@[for topic in recv_topics]@
+    _@(topic)_sub.unregisterType();
+@[end for]@
+}
+
+void RtpsTopics::removeParticipants()
 {
+    if (_owns_participants) {
+        for (Participant* participant : _participants) {
+            Domain::removeParticipant(participant);
+        }
+    }
+    _participants.clear();
+}
+
+bool RtpsTopics::createParticipants(const std::string& ns, size_t count)
+{
+    count = std::max<size_t>(1, std::min<size_t>(count, @(len(all_topics))));
+
+    for (size_t i = 0; i < count; i++) {
+        ParticipantAttributes PParam;
+@[if version.parse(fastrtps_version) < version.parse('2.0')]@
+        PParam.rtps.builtin.domainId = 0;
+@[else]@
+        PParam.domainId = 0;
+@[end if]@
+@[if version.parse(fastrtps_version) <= version.parse('1.8.4')]@
+        PParam.rtps.builtin.leaseDuration = c_TimeInfinite;
+@[else]@
+        PParam.rtps.builtin.discovery_config.leaseDuration = c_TimeInfinite;
+@[end if]@
+        std::string nodeName = ns;
+        nodeName.append("micrortps_agent");
+        if (count > 1) {
+            nodeName.append("_" + std::to_string(i));
+        }
+        PParam.rtps.setName(nodeName.c_str());
+
+        Participant* participant = Domain::createParticipant(PParam);
+        if (participant == nullptr) {
+            return false;
+        }
+        _participants.push_back(participant);
+    }
+
+    return true;
+}
+
+bool RtpsTopics::init(SendQueue* t_send_queue, const std::string& ns, size_t queue_depth, OverflowPolicy policy,
+                      bool coalesce, bool passthrough, size_t participants, bool lazy)
+{
+    // All the topics share a few participants instead of creating one each
+    if (_participants.empty() && !createParticipants(ns, participants)) {
+        std::cerr << "Failed creating the DDS participants" << std::endl;
+        return false;
+    }
+
 @[if recv_topics]@
     // Initialise subscribers
     std::cout << "\033[0;36m---   Subscribers   ---\033[0m" << std::endl;
 @[for topic in recv_topics]@
-    if (_@(topic)_sub.init(@(rtps_message_id(ids, topic)), t_send_queue_cv, t_send_queue_mutex, t_send_queue, ns)) {
+    if (!checkMaxSerializedSize<@(topic)_msg_t>(topic_layout::@(topic)::max_serialized_size)) {
+        std::cerr << "@(topic) serializes larger than its generated layout, please regenerate the agent" << std::endl;
+        return false;
+    }
+    if (_@(topic)_sub.init(participantOf(@(all_topics.index(topic))), @(rtps_message_id(ids, topic)), t_send_queue, ns,
+                           queue_depth, policy, coalesce)) {
         std::cout << "- @(topic) subscriber started" << std::endl;
     } else {
         std::cerr << "Failed starting @(topic) subscriber" << std::endl;
@@ -72,94 +170,263 @@ bool RtpsTopics::init(std::condition_variable* t_send_queue_cv, std::mutex* t_se
     std::cout << "\033[0;36m-----------------------\033[0m" << std::endl << std::endl;
 @[end if]@
 @[if send_topics]@
-    // Initialise publishers
+    // Initialise publishers. In lazy mode, they are created on the first sample of their topic instead
+    _ns = ns;
+    _passthrough = passthrough;
     std::cout << "\033[0;36m----   Publishers  ----\033[0m" << std::endl;
 @[for topic in send_topics]@
-    if (_@(topic)_pub.init(ns)) {
-        std::cout << "- @(topic) publisher started" << std::endl;
 @[    if topic == 'Timesync' or topic == 'timesync']@
-        _timesync->start(&_@(topic)_pub);
+    if (!startPublisher_@(topic)()) {
+@[    else]@
+    if (!lazy && !startPublisher_@(topic)()) {
 @[    end if]@
-    } else {
-        std::cerr << "ERROR starting @(topic) publisher" << std::endl;
         return false;
     }
 @[end for]@
+    if (lazy) {
+        std::cout << "- Other publishers started on the first sample of their topic" << std::endl;
+    }
     std::cout << "\033[0;36m-----------------------\033[0m" << std::endl;
+@[else]@
+    (void)lazy;
 @[end if]@
     return true;
 }
 
+RtpsTopics::RtpsTopics()
+    : _handlers{
+@[for topic in all_topics]@
+        {@(rtps_message_id(ids, topic)), "@(topic)", @('&RtpsTopics::publish_' + topic if topic in send_topics else 'nullptr'), @('&RtpsTopics::getMsg_' + topic if topic in recv_topics else 'nullptr')}, // @(topic)
+@[end for]@
+      },
+      _disabled_handler{0, "", nullptr, nullptr},
+      _unpublished_handlers{
+@[for topic in all_topics]@
+        {@(rtps_message_id(ids, topic)), "@(topic)", nullptr, @('&RtpsTopics::getMsg_' + topic if topic in recv_topics else 'nullptr')}, // @(topic)
+@[end for]@
+      }
+{
+    for (auto& entry : _dispatch) {
+        entry.store(nullptr, std::memory_order_relaxed);
+    }
+    for (auto& interval_ns : _min_interval_ns) {
+        interval_ns.store(0, std::memory_order_relaxed);
+    }
+    for (const TopicHandler& handler : _handlers) {
+        _dispatch[handler.topic_ID].store(&handler, std::memory_order_relaxed);
+    }
+}
+
+bool RtpsTopics::setTopicEnabled(const uint8_t topic_ID, bool enabled)
+{
+    for (const TopicHandler& handler : _handlers) {
+        if (handler.topic_ID == topic_ID) {
+            // A disabled topic keeps an entry, so its messages are dropped without being reported as unexpected
+            _dispatch[topic_ID].store(enabled ? &handler : &_disabled_handler, std::memory_order_release);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool RtpsTopics::setTopicMaxRate(const uint8_t topic_ID, double max_rate_hz)
+{
+    for (const TopicHandler& handler : _handlers) {
+        if (handler.topic_ID == topic_ID) {
+            _min_interval_ns[topic_ID].store((max_rate_hz > 0.0) ? (uint64_t)(1e9 / max_rate_hz) : 0,
+                                             std::memory_order_relaxed);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+int RtpsTopics::getTopicID(const std::string& name) const
+{
+    auto normalized = [](const std::string& topic) {
+        std::string result;
+        for (char c : topic) {
+            if ('_' != c) {
+                result += (char)tolower(c);
+            }
+        }
+        return result;
+    };
+
+    const std::string wanted = normalized(name);
+
+    for (const TopicHandler& handler : _handlers) {
+        if (normalized(handler.name) == wanted) {
+            return handler.topic_ID;
+        }
+    }
+
+    return -1;
+}
+
+const char* RtpsTopics::getTopicName(const uint8_t topic_ID) const
+{
+    for (const TopicHandler& handler : _handlers) {
+        if (handler.topic_ID == topic_ID) {
+            return handler.name;
+        }
+    }
+
+    return nullptr;
+}
+
 @[if send_topics]@
 void RtpsTopics::publish(uint8_t topic_ID, char data_buffer[], size_t len)
 {
-    switch (topic_ID)
-    {
+    const TopicHandler* handler = _dispatch[topic_ID].load(std::memory_order_acquire);
+
+    if (nullptr != handler && nullptr != handler->publish) {
+        eprosima::fastcdr::FastBuffer cdrbuffer(data_buffer, len);
+        eprosima::fastcdr::Cdr cdr_des(cdrbuffer);
+        (this->*handler->publish)(data_buffer, len, cdr_des);
+    } else if (nullptr == handler) {
+        printf("\033[1;33m[   micrortps_agent   ]\tUnexpected topic ID '%hhu' to publish Please make sure the agent is capable of parsing the message associated to the topic ID '%hhu'\033[0m\n", topic_ID, topic_ID);
+    }
+}
+
+void RtpsTopics::disablePublishing(const uint8_t topic_ID)
+{
+    for (const TopicHandler& handler : _unpublished_handlers) {
+        if (handler.topic_ID == topic_ID) {
+            _dispatch[topic_ID].store(&handler, std::memory_order_release);
+            return;
+        }
+    }
+}
 @[for topic in send_topics]@
-        case @(rtps_message_id(ids, topic)): // @(topic)
-        {
-            @(topic)_msg_t st;
-            eprosima::fastcdr::FastBuffer cdrbuffer(data_buffer, len);
-            eprosima::fastcdr::Cdr cdr_des(cdrbuffer);
-            st.deserialize(cdr_des);
-@[    if topic == 'Timesync' or topic == 'timesync']@
-            _timesync->processTimesyncMsg(&st);
 
-            if (getMsgSysID(&st) == 1) {
+bool RtpsTopics::startPublisher_@(topic)()
+{
+@[    if topic in passthrough_topics]@
+    bool passthrough = _passthrough && checkTimestampOffset<@(topic)_msg_t>(topic_layout::@(topic)::timestamp_offset);
+    if (_passthrough && !passthrough) {
+        std::cout << "- @(topic) timestamp offset mismatch, decoding it instead of passing it through" << std::endl;
+    }
+    if (!_@(topic)_pub.init(participantOf(@(all_topics.index(topic))), _ns, passthrough)) {
+@[    else]@
+    if (!_@(topic)_pub.init(participantOf(@(all_topics.index(topic))), _ns)) {
 @[    end if]@
-            // apply timestamp offset
-            uint64_t timestamp = getMsgTimestamp(&st);
-            _timesync->subtractOffset(timestamp);
-            setMsgTimestamp(&st, timestamp);
-            _@(topic)_pub.publish(&st);
+        std::cerr << "ERROR starting @(topic) publisher" << std::endl;
+        return false;
+    }
+
+    std::cout << "- @(topic) publisher started" << std::endl;
 @[    if topic == 'Timesync' or topic == 'timesync']@
-            }
+    _timesync->start(&_@(topic)_pub);
 @[    end if]@
-        }
-        break;
+    _@(topic)_pub_started.store(true, std::memory_order_release);
+    return true;
+}
 @[end for]@
-        default:
-            printf("\033[1;33m[   micrortps_agent   ]\tUnexpected topic ID '%hhu' to publish Please make sure the agent is capable of parsing the message associated to the topic ID '%hhu'\033[0m\n", topic_ID, topic_ID);
-        break;
+@[for topic in send_topics]@
+
+void RtpsTopics::publish_@(topic)(char data_buffer[], size_t len, eprosima::fastcdr::Cdr &cdr_des)
+{
+    // The frame waits in the receive buffer while a lazy publisher is created, by the first writer thread to get
+    // the lock. One that fails stops the topic from being published, but not from being sent to the link
+    if (!_@(topic)_pub_started.load(std::memory_order_acquire)) {
+        std::lock_guard<std::mutex> lock(_start_mutex);
+        if (!_@(topic)_pub_started.load(std::memory_order_relaxed) && !startPublisher_@(topic)()) {
+            disablePublishing(@(rtps_message_id(ids, topic)));
+            return;
+        }
+    }
+
+@[    if topic in passthrough_topics]@
+    if (_@(topic)_pub.isPassthrough()) {
+        // Translate the timestamp in place and publish the payload as the client serialized it
+        subtractTimestampOffset(data_buffer, len, topic_layout::@(topic)::timestamp_offset);
+        _@(topic)_pub.publish(data_buffer, len);
+        return;
     }
+
+@[    else]@
+    (void)data_buffer;
+    (void)len;
+
+@[    end if]@
+    @(topic)_msg_t& st = _@(topic)_pub_msg;
+    st.deserialize(cdr_des);
+@[    if topic == 'Timesync' or topic == 'timesync']@
+    _timesync->processTimesyncMsg(&st);
+
+    if (getMsgSysID(&st) == 1) {
+@[    end if]@
+    // apply timestamp offset
+    uint64_t timestamp = getMsgTimestamp(&st);
+    _timesync->subtractOffset(timestamp);
+    setMsgTimestamp(&st, timestamp);
+    _@(topic)_pub.publish(&st);
+@[    if topic == 'Timesync' or topic == 'timesync']@
+    }
+@[    end if]@
 }
+@[end for]@
 @[end if]@
 @[if recv_topics]@
 
 bool RtpsTopics::getMsg(const uint8_t topic_ID, eprosima::fastcdr::Cdr &scdr)
 {
-    bool ret = false;
-    switch (topic_ID)
-    {
+    const TopicHandler* handler = _dispatch[topic_ID].load(std::memory_order_acquire);
+
+    if (nullptr != handler && nullptr != handler->getMsg) {
+        return (this->*handler->getMsg)(scdr);
+    } else if (nullptr == handler) {
+        printf("\033[1;33m[   micrortps_agent   ]\tUnexpected topic ID '%hhu' to getMsg. Please make sure the agent is capable of parsing the message associated to the topic ID '%hhu'\033[0m\n", topic_ID, topic_ID);
+    }
+
+    return false;
+}
 @[for topic in recv_topics]@
-        case @(rtps_message_id(ids, topic)): // @(topic)
-            if (_@(topic)_sub.hasMsg())
-            {
-                @(topic)_msg_t msg = _@(topic)_sub.getMsg();
-@[    if topic == 'Timesync' or topic == 'timesync']@
-                if (getMsgSysID(&msg) == 0) {
-@[    end if]@
-                // apply timestamps offset
-                uint64_t timestamp = getMsgTimestamp(&msg);
-                uint64_t timestamp_sample = getMsgTimestampSample(&msg);
-                _timesync->addOffset(timestamp);
-                setMsgTimestamp(&msg, timestamp);
-                _timesync->addOffset(timestamp_sample);
-                setMsgTimestampSample(&msg, timestamp_sample);
-                msg.serialize(scdr);
-                ret = true;
+
+bool RtpsTopics::getMsg_@(topic)(eprosima::fastcdr::Cdr &scdr)
+{
+    @(topic)_msg_t& msg = _@(topic)_sub_msg;
+    if (!_@(topic)_sub.takeMsg(msg, &_msg_received)) {
+        return false;
+    }
+
+    // Taken anyway, so that a decimated topic does not hold on to stale samples
+    const bool admitted = underMaxRate(@(rtps_message_id(ids, topic)), _last_sent_ns[@(rtps_message_id(ids, topic))]);
+    if (nullptr != _stats) {
+        countSendDrops(@(rtps_message_id(ids, topic)), _@(topic)_sub.getOverflows(), !admitted);
+    }
+    if (!admitted) {
+        return false;
+    }
+
 @[    if topic == 'Timesync' or topic == 'timesync']@
-                }
+    if (getMsgSysID(&msg) != 0) {
+        return false;
+    }
+
 @[    end if]@
-                _@(topic)_sub.unlockMsg();
-            }
-        break;
+    // apply timestamps offset
+    uint64_t timestamp = getMsgTimestamp(&msg);
+    uint64_t timestamp_sample = getMsgTimestampSample(&msg);
+    _timesync->addOffset(timestamp);
+    setMsgTimestamp(&msg, timestamp);
+    _timesync->addOffset(timestamp_sample);
+    setMsgTimestampSample(&msg, timestamp_sample);
+    msg.serialize(scdr);
+    return true;
+}
 @[end for]@
-        default:
-            printf("\033[1;33m[   micrortps_agent   ]\tUnexpected topic ID '%hhu' to getMsg. Please make sure the agent is capable of parsing the message associated to the topic ID '%hhu'\033[0m\n", topic_ID, topic_ID);
-        break;
-    }
 
-    return ret;
+void RtpsTopics::printOverflows()
+{
+@[for topic in recv_topics]@
+    if (_@(topic)_sub.getOverflows() > 0) {
+        printf("\033[1;33m[   micrortps_agent   ]\t@(topic): %lu samples dropped on a full queue\033[0m\n",
+               (unsigned long)_@(topic)_sub.getOverflows());
+    }
+@[end for]@
 }
 @[end if]@
@@ -21,6 +21,7 @@ from px_generate_uorb_topic_files import MsgScope # this is in Tools/
 send_topics = [(alias[idx] if alias[idx] else s.short_name) for idx, s in enumerate(spec) if scope[idx] == MsgScope.SEND]
 recv_topics = [(alias[idx] if alias[idx] else s.short_name) for idx, s in enumerate(spec) if scope[idx] == MsgScope.RECEIVE]
 package = package[0]
+all_topics = list(dict.fromkeys(send_topics + recv_topics))
 fastrtps_version = fastrtps_version[0]
 try:
     ros2_distro = ros2_distro[0].decode("utf-8")
@@ -61,11 +62,20 @@ except AttributeError:
  ****************************************************************************/
 
 #include <fastcdr/Cdr.h>
-#include <condition_variable>
-#include <queue>
+#include <fastrtps/fastrtps_fwd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <mutex>
+#include <string>
 #include <type_traits>
+#include <vector>
 
+#include "microRTPS_send_queue.h"
+#include "microRTPS_stats.h"
 #include "microRTPS_timesync.h"
+#include "microRTPS_topic_layout.h"
 
 @[for topic in send_topics]@
 #include "@(topic)_Publisher.h"
@@ -93,30 +103,156 @@ using @(topic)_msg_t = @(topic);
 
 class RtpsTopics {
 public:
-    bool init(std::condition_variable* t_send_queue_cv, std::mutex* t_send_queue_mutex, std::queue<uint8_t>* t_send_queue, const std::string& ns);
+    RtpsTopics();
+    ~RtpsTopics();
+    bool init(SendQueue* t_send_queue, const std::string& ns, size_t queue_depth = 1,
+              OverflowPolicy policy = OverflowPolicy::DROP_OLDEST, bool coalesce = false, bool passthrough = false,
+              size_t participants = 1, bool lazy = false);
     void set_timesync(const std::shared_ptr<TimeSync>& timesync) { _timesync = timesync; };
+    /** Bridges the topics over the participants of another instance, e.g. of another link, instead of creating
+        participants in init(). The other instance owns them and must outlive this one **/
+    void shareParticipants(const RtpsTopics& owner)
+    {
+        _participants = owner._participants;
+        _owns_participants = false;
+    }
+    /** Teardown, in this order over every instance sharing the participants, once nothing publishes anymore: removes
+        the publishers and subscribers, so that their listeners are no longer called, then the topic types registered
+        from this instance, then the participants if this instance owns them. Each may be called again **/
+    void removeEndpoints();
+    void removeTopics();
+    void removeParticipants();
+    bool setTopicEnabled(const uint8_t topic_ID, bool enabled);
+    /** Limits the rate a topic is bridged at, in each direction, by dropping its messages over it. 0 for no limit **/
+    bool setTopicMaxRate(const uint8_t topic_ID, double max_rate_hz);
+    /** ID of a bridged topic by name, ignoring case and underscores. -1 if it is not bridged **/
+    int getTopicID(const std::string& name) const;
+    /** Name of a bridged topic by ID, nullptr if it is not bridged **/
+    const char* getTopicName(const uint8_t topic_ID) const;
+    /** Counts the samples dropped before being sent, decimated or on a full queue, in stats. nullptr stops **/
+    void setStats(LinkStats* stats) { _stats = stats; }
+    /**
+     * @@brief Whether a frame just received from the link is to be published: false if its topic is disabled, has no
+     *        publisher to take it or is over its max rate. Meant for the frame decoder, before anything else is done
+     *        with the frame. Single thread
+     */
+    inline bool admitReceived(const uint8_t topic_ID)
+    {
+        const TopicHandler* handler = _dispatch[topic_ID].load(std::memory_order_relaxed);
+        return handler != &_disabled_handler && (nullptr == handler || nullptr != handler->publish) &&
+               underMaxRate(topic_ID, _last_received_ns[topic_ID]);
+    }
 @[if send_topics]@
     void publish(uint8_t topic_ID, char data_buffer[], size_t len);
 @[end if]@
 @[if recv_topics]@
     bool getMsg(const uint8_t topic_ID, eprosima::fastcdr::Cdr &scdr);
+    /** When the sample last returned by getMsg() was received from DDS **/
+    std::chrono::steady_clock::time_point getMsgReceived() const { return _msg_received; }
+    void printOverflows();
 @[end if]@
 
 private:
+    /** DDS participants shared by the publishers and subscribers, topics are spread over them in turn **/
+    std::vector<eprosima::fastrtps::Participant*> _participants;
+    bool _owns_participants = true;
+    bool createParticipants(const std::string& ns, size_t count);
+    eprosima::fastrtps::Participant* participantOf(size_t topic_index) const
+    {
+        return _participants[topic_index % _participants.size()];
+    }
+
 @[if send_topics]@
-    /** Publishers **/
+    /** Publishers, and the msgs decoded for them. A msg is reused for every frame of its topic, and on a cache line
+        of its own since the topics may be published from different writer threads **/
 @[for topic in send_topics]@
     @(topic)_Publisher _@(topic)_pub;
+    alignas(64) @(topic)_msg_t _@(topic)_pub_msg;
+    std::atomic<bool> _@(topic)_pub_started{false}; // Set, with release, once the publisher is fully created
+    bool startPublisher_@(topic)();
 @[end for]@
+
+    /** Stops publishing a topic whose publisher could not be created, leaving its DDS to link direction running **/
+    void disablePublishing(const uint8_t topic_ID);
+
+    /** Kept from init() for the publishers created lazily **/
+    std::string _ns;
+    bool _passthrough = false;
+    /** Serializes the lazy creation of publishers, as a topic may be published from several writer threads **/
+    std::mutex _start_mutex;
 @[end if]@
 
 @[if recv_topics]@
-    /** Subscribers **/
+    /** Subscribers, and the msgs taken from them to be sent, reused for every sample **/
 @[for topic in recv_topics]@
     @(topic)_Subscriber _@(topic)_sub;
+    @(topic)_msg_t _@(topic)_sub_msg;
 @[end for]@
+    std::chrono::steady_clock::time_point _msg_received;
 @[end if]@
 
+    /** Per topic handlers **/
+@[for topic in send_topics]@
+    void publish_@(topic)(char data_buffer[], size_t len, eprosima::fastcdr::Cdr &cdr_des);
+@[end for]@
+@[for topic in recv_topics]@
+    bool getMsg_@(topic)(eprosima::fastcdr::Cdr &scdr);
+@[end for]@
+
+    /** Dispatch entry of a topic: nullptr for a direction it is not bridged in **/
+    struct TopicHandler {
+        uint8_t topic_ID;
+        const char* name;
+        void (RtpsTopics::*publish)(char data_buffer[], size_t len, eprosima::fastcdr::Cdr &cdr_des);
+        bool (RtpsTopics::*getMsg)(eprosima::fastcdr::Cdr &scdr);
+    };
+
+    /**
+     * @@brief Handlers of all the bridged topics, next to each other, and the table indexed by topic ID pointing to
+     *         them. Entries are swapped atomically to enable or disable a topic while the bridge runs.
+     */
+    const TopicHandler _handlers[@(len(all_topics))];
+    const TopicHandler _disabled_handler;
+    const TopicHandler _unpublished_handlers[@(len(all_topics))]; ///< As _handlers, without publish
+    std::atomic<const TopicHandler*> _dispatch[256];
+
+    /** Shortest interval between two messages of each topic, 0 for no limit, and when one last went through in each
+        direction: received from the link (frame decoder) and sent to it (sender) **/
+    std::atomic<uint64_t> _min_interval_ns[256];
+    uint64_t _last_received_ns[256] = {};
+    uint64_t _last_sent_ns[256] = {};
+
+    /** Sender side drop counts, and the queue overflows of each topic already counted in them **/
+    LinkStats* _stats = nullptr;
+    uint64_t _counted_overflows[256] = {};
+
+    inline void countSendDrops(const uint8_t topic_ID, uint64_t overflows, bool decimated)
+    {
+        const uint64_t dropped = overflows - _counted_overflows[topic_ID] + (decimated ? 1 : 0);
+        _counted_overflows[topic_ID] = overflows;
+        if (dropped > 0) {
+            _stats->topics[topic_ID].send_dropped.fetch_add(dropped, std::memory_order_relaxed);
+        }
+    }
+
+    inline bool underMaxRate(const uint8_t topic_ID, uint64_t& last_ns)
+    {
+        const uint64_t interval_ns = _min_interval_ns[topic_ID].load(std::memory_order_relaxed);
+        if (0 == interval_ns) {
+            return true;
+        }
+
+        const uint64_t now_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                    std::chrono::steady_clock::now().time_since_epoch()).count();
+        if (now_ns - last_ns < interval_ns) {
+            return false;
+        }
+
+        // Keeps the cadence of a steady stream instead of drifting by the arrival jitter of each message
+        last_ns = (now_ns - last_ns < 2 * interval_ns) ? last_ns + interval_ns : now_ns;
+        return true;
+    }
+
     // SFINAE
     template<typename T> struct hasTimestampSample{
     private:
@@ -198,6 +334,52 @@ private:
     template <class T>
     inline void setMsgTimestampSample(T* msg, const uint64_t& timestamp_sample) { setMsgTimestampSample_impl(msg, timestamp_sample); }
 
+    /** Serialized msg timestamp translation, for passthrough publishing **/
+    inline void subtractTimestampOffset(char data_buffer[], size_t len, int32_t offset)
+    {
+        uint64_t timestamp;
+        if (0 <= offset && offset + sizeof(timestamp) <= len) {
+            memcpy(&timestamp, data_buffer + offset, sizeof(timestamp));
+            _timesync->subtractOffset(timestamp);
+            memcpy(data_buffer + offset, &timestamp, sizeof(timestamp));
+        }
+    }
+
+    /**
+     * @@brief Checks a generator computed timestamp offset against the CDR produced by the msg type itself,
+     *         in case the IDL orders the fields differently from the msg definition.
+     */
+    template <class T>
+    bool checkTimestampOffset(int32_t offset)
+    {
+        if (offset < 0) {
+            return false;
+        }
+
+        const uint64_t probe = 0x0102030405060708;
+        T msg;
+        setMsgTimestamp(&msg, probe);
+
+        std::vector<char> buffer(T::getMaxCdrSerializedSize());
+        eprosima::fastcdr::FastBuffer cdrbuffer(buffer.data(), buffer.size());
+        eprosima::fastcdr::Cdr scdr(cdrbuffer);
+        msg.serialize(scdr);
+
+        uint64_t timestamp = 0;
+        if (offset + sizeof(timestamp) > scdr.getSerializedDataLength()) {
+            return false;
+        }
+        memcpy(&timestamp, buffer.data() + offset, sizeof(timestamp));
+        return timestamp == probe;
+    }
+
+    /** Checks that the msg type fits the send buffers, which are sized from the generated layout **/
+    template <class T>
+    bool checkMaxSerializedSize(size_t max_serialized_size)
+    {
+        return 0 == max_serialized_size || T::getMaxCdrSerializedSize() <= max_serialized_size;
+    }
+
     /**
      * @@brief Timesync object ptr.
      *         This object is used to compuyte and apply the time offsets to the
@@ -17,6 +17,7 @@ import genmsg.msgs
 from px_generate_uorb_topic_helper import * # this is in Tools/
 
 topic = alias if alias else spec.short_name
+qos = rtps_message_qos(ids, topic)
 try:
     ros2_distro = ros2_distro.decode("utf-8")
 except AttributeError:
@@ -78,40 +79,56 @@ except AttributeError:
 
 @(topic)_Subscriber::~@(topic)_Subscriber()
 {
-    Domain::removeParticipant(mp_participant);
+    // Removed by RtpsTopics before the participant, which is shared with the other topics
+    remove();
 }
 
-bool @(topic)_Subscriber::init(uint8_t topic_ID, std::condition_variable* t_send_queue_cv, std::mutex* t_send_queue_mutex, std::queue<uint8_t>* t_send_queue, const std::string& ns)
+void @(topic)_Subscriber::remove()
+{
+    if (mp_subscriber != nullptr) {
+        Domain::removeSubscriber(mp_subscriber);
+        mp_subscriber = nullptr;
+    }
+}
+
+void @(topic)_Subscriber::unregisterType()
+{
+    TopicDataType* registered_type = nullptr;
+    if (mp_participant != nullptr &&
+        Domain::getRegisteredType(mp_participant, @(topic)DataType.getName(), &registered_type) &&
+        registered_type == &@(topic)DataType) {
+        Domain::unregisterType(mp_participant, @(topic)DataType.getName());
+    }
+    mp_participant = nullptr;
+}
+
+bool @(topic)_Subscriber::init(Participant* participant, uint8_t topic_ID, SendQueue* t_send_queue, const std::string& ns,
+                               size_t queue_depth, OverflowPolicy policy, bool coalesce)
 {
     m_listener.topic_ID = topic_ID;
-    m_listener.t_send_queue_cv = t_send_queue_cv;
-    m_listener.t_send_queue_mutex = t_send_queue_mutex;
     m_listener.t_send_queue = t_send_queue;
+    m_listener.coalesce = coalesce;
 
-    // Create RTPSParticipant
-    ParticipantAttributes PParam;
-@[if version.parse(fastrtps_version) < version.parse('2.0')]@
-    PParam.rtps.builtin.domainId = 0;
-@[else]@
-    PParam.domainId = 0;
-@[end if]@
-@[if version.parse(fastrtps_version) <= version.parse('1.8.4')]@
-    PParam.rtps.builtin.leaseDuration = c_TimeInfinite;
-@[else]@
-    PParam.rtps.builtin.discovery_config.leaseDuration = c_TimeInfinite;
-@[end if]@
-    std::string nodeName = ns;
-    nodeName.append("@(topic)_subscriber");
-    PParam.rtps.setName(nodeName.c_str());
-    mp_participant = Domain::createParticipant(PParam);
+    // Coalescing keeps the latest value only
+    if (coalesce) {
+        m_listener.samples.init(1, OverflowPolicy::DROP_OLDEST);
+    } else {
+        m_listener.samples.init(queue_depth, policy);
+    }
+
+    mp_participant = participant;
     if(mp_participant == nullptr)
-            return false;
+        return false;
 
-    //Register the type
-    Domain::registerType(mp_participant, static_cast<TopicDataType*>(&@(topic)DataType));
+    // Register the type, unless the participant already has it from the publisher of the same topic
+    TopicDataType* registered_type = nullptr;
+    if (!Domain::getRegisteredType(mp_participant, @(topic)DataType.getName(), &registered_type)) {
+        Domain::registerType(mp_participant, static_cast<TopicDataType*>(&@(topic)DataType));
+    }
 
-    // Create Subscriber
+    // Create Subscriber, from the default subscriber profile of the Fast-RTPS XML profiles file if one is loaded
     SubscriberAttributes Rparam;
+    Domain::getDefaultSubscriberAttributes(Rparam);
     Rparam.topic.topicKind = NO_KEY;
     Rparam.topic.topicDataType = @(topic)DataType.getName();
 @[if ros2_distro]@
@@ -130,6 +147,22 @@ bool @(topic)_Subscriber::init(uint8_t topic_ID, std::condition_variable* t_send
     std::string topicName = ns;
     topicName.append("@(topic)PubSubTopic");
     Rparam.topic.topicName = topicName;
+@[end if]@
+@[if qos]@
+
+    // QoS set for the topic in the RTPS IDs file
+@[end if]@
+@[if 'reliability' in qos]@
+    Rparam.qos.m_reliability.kind = @('BEST_EFFORT_RELIABILITY_QOS' if qos['reliability'] == 'best_effort' else 'RELIABLE_RELIABILITY_QOS');
+@[end if]@
+@[if 'durability' in qos]@
+    Rparam.qos.m_durability.kind = @('TRANSIENT_LOCAL_DURABILITY_QOS' if qos['durability'] == 'transient_local' else 'VOLATILE_DURABILITY_QOS');
+@[end if]@
+@[if 'history' in qos]@
+    Rparam.topic.historyQos.kind = @('KEEP_ALL_HISTORY_QOS' if qos['history'] == 'keep_all' else 'KEEP_LAST_HISTORY_QOS');
+@[end if]@
+@[if 'depth' in qos]@
+    Rparam.topic.historyQos.depth = @(qos['depth']);
 @[end if]@
     mp_subscriber = Domain::createSubscriber(mp_participant, Rparam, static_cast<SubscriberListener*>(&m_listener));
     if(mp_subscriber == nullptr)
@@ -176,52 +209,60 @@ void @(topic)_Subscriber::SubListener::onSubscriptionMatched(Subscriber* sub, Ma
 void @(topic)_Subscriber::SubListener::onNewDataMessage(Subscriber* sub)
 {
     if (n_matched > 0) {
-        std::unique_lock<std::mutex> has_msg_lock(has_msg_mutex);
-        if(has_msg.load() == true) // Check if msg has been fetched
-        {
-            has_msg_cv.wait(has_msg_lock); // Wait till msg has been fetched
-        }
-        has_msg_lock.unlock();
-
         // Take data
         if(sub->takeNextData(&msg, &m_info))
         {
             if(m_info.sampleKind == ALIVE)
             {
-                std::unique_lock<std::mutex> lk(*t_send_queue_mutex);
-
                 ++n_msg;
-                has_msg = true;
-
-                t_send_queue->push(topic_ID);
-                lk.unlock();
-                t_send_queue_cv->notify_one();
 
+                // Never waits for the sender: a full ring drops a sample according to its policy. The topic is
+                // announced once for all the samples it holds, takeMsg() announces it again while any are left
+                if (samples.push(msg) && !announced.exchange(true)) {
+                    announce();
+                }
             }
         }
     }
 }
 
-bool @(topic)_Subscriber::hasMsg()
+void @(topic)_Subscriber::SubListener::announce()
 {
-    if (m_listener.n_matched > 0) {
-        return m_listener.has_msg.load();
+    if (coalesce || !t_send_queue->push(topic_ID)) {
+        t_send_queue->mark(topic_ID);
     }
-
-    return false;
 }
 
-@(topic)_msg_t @(topic)_Subscriber::getMsg()
+void @(topic)_Subscriber::SubListener::settle()
 {
-    return m_listener.msg;
+    announced.store(false);
+
+    // Pairs with the exchange in onNewDataMessage(): either the listener announces its sample or we see it here
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    if (!samples.empty() && !announced.exchange(true)) {
+        announce();
+    }
 }
 
-void @(topic)_Subscriber::unlockMsg()
+bool @(topic)_Subscriber::takeMsg(@(topic)_msg_t& msg, std::chrono::steady_clock::time_point* received)
 {
+    if (m_listener.n_matched > 0 && m_listener.samples.pop(msg, received)) {
+        if (m_listener.samples.empty()) {
+            m_listener.settle();
+        } else {
+            m_listener.announce();
+        }
+
+        return true;
+    }
+
     if (m_listener.n_matched > 0) {
-        std::unique_lock<std::mutex> has_msg_lock(m_listener.has_msg_mutex);
-        m_listener.has_msg = false;
-        has_msg_lock.unlock();
-        m_listener.has_msg_cv.notify_one();
+        m_listener.settle();
+    } else {
+        // Left for after the next match, whose first sample announces the topic again
+        m_listener.announced.store(false);
     }
+
+    return false;
 }
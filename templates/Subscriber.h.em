@@ -75,9 +75,7 @@ except AttributeError:
 #include "@(topic)PubSubTypes.h"
 @[end if]@
 
-#include <atomic>
-#include <condition_variable>
-#include <queue>
+#include "microRTPS_send_queue.h"
 
 using namespace eprosima::fastrtps;
 using namespace eprosima::fastrtps::rtps;
@@ -105,34 +103,44 @@ class @(topic)_Subscriber
 public:
     @(topic)_Subscriber();
     virtual ~@(topic)_Subscriber();
-    bool init(uint8_t topic_ID, std::condition_variable* t_send_queue_cv, std::mutex* t_send_queue_mutex, std::queue<uint8_t>* t_send_queue, const std::string& ns);
+    bool init(Participant* participant, uint8_t topic_ID, SendQueue* t_send_queue, const std::string& ns,
+              size_t queue_depth = 1, OverflowPolicy policy = OverflowPolicy::DROP_OLDEST, bool coalesce = false);
     void run();
-    bool hasMsg();
-    @(topic)_msg_t getMsg();
-    void unlockMsg();
+    /** Takes the oldest sample received, and when it was received if received is not nullptr **/
+    bool takeMsg(@(topic)_msg_t& msg, std::chrono::steady_clock::time_point* received = nullptr);
+    uint64_t getOverflows() const { return m_listener.samples.overflows(); }
+    /** Removes the subscriber from DDS, so that its listener is no longer called. Before the participant goes **/
+    void remove();
+    /** Unregisters the topic type from the participant if registered by this instance, since the participant refers
+        to it. Once no endpoint of the topic is left on the participant **/
+    void unregisterType();
 
 private:
-    Participant *mp_participant;
+    Participant *mp_participant; // Shared, owned by RtpsTopics
     Subscriber *mp_subscriber;
 
     class SubListener : public SubscriberListener
     {
     public:
-        SubListener() : n_matched(0), n_msg(0), has_msg(false){};
+        SubListener() : n_matched(0), n_msg(0), coalesce(false), announced(false){};
         ~SubListener(){};
         void onSubscriptionMatched(Subscriber* sub, MatchingInfo& info);
         void onNewDataMessage(Subscriber* sub);
+        /** Queues the topic ID for the sender, or flags the topic if coalescing or the queue is full **/
+        void announce();
+        /** Clears announced once the sender finds no sample left, announcing again if one raced in **/
+        void settle();
         SampleInfo_t m_info;
         int n_matched;
         int n_msg;
-        @(topic)_msg_t msg;
-        std::atomic_bool has_msg;
+        @(topic)_msg_t msg; // Reused for every sample taken, swapped with a recycled one by the ring
+        SampleRing<@(topic)_msg_t> samples; // Taken samples waiting for the sender
         uint8_t topic_ID;
-        std::condition_variable* t_send_queue_cv;
-        std::mutex* t_send_queue_mutex;
-        std::queue<uint8_t>* t_send_queue;
-        std::condition_variable has_msg_cv;
-        std::mutex has_msg_mutex;
+        SendQueue* t_send_queue;
+        bool coalesce; // Flag the topic as dirty instead of queueing its ID
+        // The topic ID is queued, or the sender is taking samples: new samples do not queue it again, so the
+        // sender never pops an ID for a sample a full ring has evicted
+        std::atomic<bool> announced;
 
     } m_listener;
     @(topic)_msg_datatype @(topic)DataType;
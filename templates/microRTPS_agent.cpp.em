@@ -18,6 +18,8 @@ from px_generate_uorb_topic_files import MsgScope # this is in Tools/
 
 send_topics = [(alias[idx] if alias[idx] else s.short_name) for idx, s in enumerate(spec) if scope[idx] == MsgScope.SEND]
 recv_topics = [(alias[idx] if alias[idx] else s.short_name) for idx, s in enumerate(spec) if scope[idx] == MsgScope.RECEIVE]
+has_timesync = any(topic in ('Timesync', 'timesync') for topic in send_topics)
+timesync_topic = next((topic for topic in send_topics if topic in ('Timesync', 'timesync')), None)
 }@
 /****************************************************************************
  *
@@ -56,20 +58,25 @@ recv_topics = [(alias[idx] if alias[idx] else s.short_name) for idx, s in enumer
 #include <atomic>
 #include <unistd.h>
 #include <poll.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
 #include <chrono>
 #include <ctime>
 #include <csignal>
+#include <cerrno>
 #include <termios.h>
-#include <condition_variable>
-#include <queue>
 
 #include <fastcdr/Cdr.h>
 #include <fastcdr/FastCdr.h>
 #include <fastcdr/exceptions/Exception.h>
 #include <fastrtps/Domain.h>
 
+#include "microRTPS_pipeline.h"
+#include "microRTPS_send_queue.h"
+#include "microRTPS_stats.h"
 #include "microRTPS_transport.h"
 #include "microRTPS_timesync.h"
+#include "microRTPS_topic_layout.h"
 #include "RtpsTopics.h"
 
 // Default values
@@ -81,22 +88,50 @@ recv_topics = [(alias[idx] if alias[idx] else s.short_name) for idx, s in enumer
 #define DEFAULT_RECV_PORT 2020
 #define DEFAULT_SEND_PORT 2019
 #define DEFAULT_IP "127.0.0.1"
+#define UDP_BATCH_SIZE 1
+#define UDP_BATCH_TIMEOUT_US 1000
+#define URING_DEPTH 8
+#define SAMPLE_QUEUE_DEPTH 8
+#define PARTICIPANTS 1
+#define PUBLISH_THREADS 0
+#define PUBLISH_QUEUE_DEPTH 64
+#define LINK_RING_DEPTH 64
+#define MAX_LINKS 16
+#define STATS_PERIOD_MS 1000
 
 using namespace eprosima;
 using namespace eprosima::fastrtps;
 
 volatile sig_atomic_t running = 1;
-Transport_node *transport_node = nullptr;
-RtpsTopics topics;
+volatile sig_atomic_t dump_stats = 0;
 uint32_t total_sent = 0, sent = 0;
 
 struct options {
     enum class eTransports
     {
         UART,
-        UDP
+        UDP,
+        UART_URING,
+        UDP_URING
     };
     eTransports transport = options::eTransports::UART;
+    struct link
+    {
+        eTransports transport;
+        std::string device;   // UART
+        uint32_t baudrate;    // UART, 0 for -b
+        uint16_t recv_port;   // UDP
+        uint16_t send_port;   // UDP
+        std::string ns;
+    };
+    std::vector<link> links; // Served along with the link set up by -t and its options
+    enum class eEventLoops
+    {
+        POLL,
+        EPOLL,
+        BUSY
+    };
+    eEventLoops event_loop = options::eEventLoops::EPOLL;
     char device[64] = DEVICE;
     int sleep_us = SLEEP_US;
     uint32_t baudrate = BAUDRATE;
@@ -104,48 +139,235 @@ struct options {
     uint16_t recv_port = DEFAULT_RECV_PORT;
     uint16_t send_port = DEFAULT_SEND_PORT;
     char ip[16] = DEFAULT_IP;
+    uint32_t udp_batch_size = UDP_BATCH_SIZE;
+    uint32_t udp_batch_timeout_us = UDP_BATCH_TIMEOUT_US;
+    uint32_t uring_depth = URING_DEPTH;
     bool sw_flow_control = false;
     bool hw_flow_control = false;
     bool verbose_debug = false;
+    bool coalesce = false;
+    bool passthrough = false;
+    bool lazy_publishers = false;
+    uint32_t queue_depth = SAMPLE_QUEUE_DEPTH;
+    uint32_t participants = PARTICIPANTS;
+    uint32_t publish_threads = PUBLISH_THREADS;
+    bool pipelined = false;
+    std::vector<int> cpus;       // per thread, see eThreads
+    std::vector<int> priorities; // per thread, see eThreads
+    bool lock_memory = false;
+    OverflowPolicy overflow_policy = OverflowPolicy::DROP_OLDEST;
+    std::string topics_config = "";
+    std::string stats_file = "";
     std::string ns = "";
 } _options;
 
+/* A link to a client, bridged to DDS under its own namespace and with its own time sync. The topics come last so
+   that they are destroyed first, as their listeners use the queue and the stats */
+struct Link
+{
+    Transport_node *transport_node = nullptr;
+    std::shared_ptr<TimeSync> timesync;
+@[if recv_topics]@
+    SendQueue send_queue; // Topics received from DDS waiting to be sent over the link
+@[end if]@
+    std::string ns;
+    std::unique_ptr<LinkStats> stats;
+    RtpsTopics topics;
+};
+
+/* Link 0 comes from -t and its options, the others from -E. They all share the DDS participants of link 0 and the
+   publish threads, and are served by the event loop of this thread */
+Link links[MAX_LINKS];
+size_t n_links = 1;
+
+/* Stops the links and removes their DDS entities, once the agent threads are stopped. The publishers and subscribers
+   of every link go first, while the participants of link 0 they were created on are still there, then the topic
+   types, then those participants, so that nothing is left for the destruction of links[] */
+static void shutdown_links()
+{
+    for (size_t i = 0; i < n_links; ++i)
+    {
+        delete links[i].transport_node;
+        links[i].transport_node = nullptr;
+
+        if (links[i].timesync)
+        {
+            links[i].timesync->stop();
+            links[i].timesync->reset();
+        }
+    }
+    for (size_t i = 0; i < n_links; ++i)
+    {
+        links[i].topics.removeEndpoints();
+    }
+    for (size_t i = 0; i < n_links; ++i)
+    {
+        links[i].topics.removeTopics();
+    }
+    links[0].topics.removeParticipants();
+}
+
+/* Agent threads, in the order -k and -y configure them. Publish threads take the entries left, in turn */
+enum eThreads
+{
+    LINK_READER_THREAD,
+    FRAME_DECODER_THREAD,
+    SENDER_THREAD,
+    TIMESYNC_THREAD,
+    FIRST_PUBLISH_THREAD
+};
+
 static void usage(const char *name)
 {
     printf("usage: %s [options]\n\n"
+             "  -a <publish_threads>    Writer threads publishing the samples received from the client, so that slow\n"
+             "                          DDS writes do not hold up the link. Default 0 (publish from the receive thread)\n"
              "  -b <baudrate>           UART device baudrate. Default 460800\n"
+             "  -c <coalesce>           Send only the latest sample of each received DDS topic, dropping stale ones\n"
+             "                          instead of holding up the DDS listeners\n"
+             "  -C <topics_config>      File enabling, disabling and decimating topics, one per line as\n"
+             "                          <topic>: <on|off|max rate in Hz>. Topics not listed are bridged as they come\n"
              "  -d <device>             UART device. Default /dev/ttyACM0\n"
+             "  -E <link>               Bridge another client too, e.g. another vehicle, under its own namespace and\n"
+             "                          time sync: udp:<recv_port>:<send_port>[:<namespace>] (IP from -i) or\n"
+             "                          uart:<device>[:<baudrate>[:<namespace>]]. Repeat for each link, up to 15.\n"
+             "                          Served by the epoll event loop, not with -j\n"
+             "  -e <event_loop>         [poll|epoll|busy] poll: read loop with a sender thread, epoll: sleep until the\n"
+             "                          link, send queue or timesync timer need work, busy: epoll without sleeping.\n"
+             "                          Default epoll\n"
              "  -f <sw flow control>    Activates UART link SW flow control\n"
+             "  -g <participants>       DDS participants the bridged topics are spread over. Default 1\n"
              "  -h <hw flow control>    Activates UART link HW flow control\n"
              "  -i <ip_address>         Target IP for UDP. Default 127.0.0.1\n"
+             "  -j <pipelined>          Read the link on its own thread, handing the raw bytes over to the frame decoder\n"
+             "  -k <cpus>               CPUs to pin the agent threads to: link reader, frame decoder, sender, timesync,\n"
+             "                          then the publish threads in turn, e.g. 1,2,3,3,4. -1 leaves a thread unpinned\n"
+             "  -l <queue_depth>        Samples of each received DDS topic queued while the link is busy. Default 8\n"
+             "  -L <lock memory>        Lock the agent memory with mlockall so that it is never paged out\n"
+             "  -m <udp_batch_size>     UDP datagrams per recvmmsg/sendmmsg call. Default 1 (no batching)\n"
              "  -n <namespace>          ROS 2 topics namespace. Identifies the vehicle in a multi-agent network\n"
+             "  -o <overflow_policy>    [oldest|newest] Sample dropped when a topic queue is full. Default oldest\n"
              "  -p <poll_ms>            Time in ms to poll over UART. Default 1ms\n"
              "  -r <reception port>     UDP port for receiving. Default 2019\n"
              "  -s <sending port>       UDP port for sending. Default 2020\n"
-             "  -t <transport>          [UART|UDP] Default UART\n"
+             "  -S <stats_file>         File the per topic traffic and latency stats are written to every second, as\n"
+             "                          JSON if it ends in .json, as Prometheus text otherwise. SIGUSR1 prints them too\n"
+             "  -q <uring_depth>        Reads kept in flight and writes queued by the io_uring transports. Default 8\n"
+             "  -t <transport>          [UART|UDP|UART_URING|UDP_URING] Default UART\n"
+             "  -u <udp_batch_timeout>  Time in us a sent datagram may wait for its UDP batch to fill. Default 1000us\n"
              "  -v <debug verbosity>    Add more verbosity\n"
-             "  -w <sleep_time_us>      Time in us for which each iteration sleep. Default 1ms\n",
+             "  -w <sleep_time_us>      Time in us for which each iteration sleep. Default 1ms\n"
+             "  -y <priorities>         SCHED_FIFO priorities of the agent threads, in the order of -k, e.g. 80,80,70.\n"
+             "                          0 keeps the default scheduler. Needs CAP_SYS_NICE or an rtprio limit\n"
+             "  -x <passthrough>        Publish received payloads to DDS as serialized by the client, patching their\n"
+             "                          timestamp in place instead of decoding and encoding them again\n"
+             "  -z <lazy publishers>    Create the DDS publisher of a topic on its first sample from the client, instead\n"
+             "                          of creating all of them at startup\n",
              name);
 }
 
+static std::vector<int> parse_list(const char *list)
+{
+    std::vector<int> values;
+    char *end = nullptr;
+
+    while (nullptr != list && '\0' != *list)
+    {
+        long value = strtol(list, &end, 10);
+        if (end == list) break;
+        values.push_back((int)value);
+        list = (',' == *end) ? end + 1 : end;
+    }
+
+    return values;
+}
+
+static bool parse_link(const char *spec, options::link &link)
+{
+    std::vector<std::string> fields(1);
+
+    for (const char *c = spec; '\0' != *c; ++c)
+    {
+        if (':' == *c) fields.push_back("");
+        else fields.back() += *c;
+    }
+
+    link.ns = (3 < fields.size() && !fields[3].empty()) ? fields[3] + "/" : "";
+
+    if ("udp" == fields[0] && 3 <= fields.size() && fields.size() <= 4)
+    {
+        link.transport = options::eTransports::UDP;
+        link.recv_port = strtoul(fields[1].c_str(), nullptr, 10);
+        link.send_port = strtoul(fields[2].c_str(), nullptr, 10);
+        return 0 < link.recv_port && 0 < link.send_port;
+    }
+    else if ("uart" == fields[0] && 2 <= fields.size() && fields.size() <= 4 && !fields[1].empty())
+    {
+        link.transport = options::eTransports::UART;
+        link.device = fields[1];
+        link.baudrate = (2 < fields.size()) ? strtoul(fields[2].c_str(), nullptr, 10) : 0;
+        return true;
+    }
+
+    return false;
+}
+
 static int parse_options(int argc, char **argv)
 {
     int ch;
 
-    while ((ch = getopt(argc, argv, "t:d:w:b:p:r:s:i:fhvn:")) != EOF)
+    while ((ch = getopt(argc, argv, "t:d:e:E:w:b:p:r:s:S:i:m:u:q:l:o:g:a:k:y:C:cjxzLfhvn:")) != EOF)
     {
         switch (ch)
         {
             case 't': _options.transport      = strcmp(optarg, "UDP") == 0?
                                                  options::eTransports::UDP
+                                                :strcmp(optarg, "UART_URING") == 0?
+                                                 options::eTransports::UART_URING
+                                                :strcmp(optarg, "UDP_URING") == 0?
+                                                 options::eTransports::UDP_URING
                                                 :options::eTransports::UART;    break;
+            case 'q': _options.uring_depth     = strtoul(optarg, nullptr, 10);  break;
             case 'd': if (nullptr != optarg) strcpy(_options.device, optarg);   break;
+            case 'e': _options.event_loop     = strcmp(optarg, "poll") == 0?
+                                                 options::eEventLoops::POLL
+                                                :(strcmp(optarg, "busy") == 0?
+                                                 options::eEventLoops::BUSY
+                                                :options::eEventLoops::EPOLL);  break;
+            case 'E':
+            {
+                options::link link;
+                if (!parse_link(optarg, link))
+                {
+                    printf("\033[0;31m[   micrortps_agent   ]\tInvalid link '%s'\033[0m\n", optarg);
+                    return -1;
+                }
+                _options.links.push_back(link);
+            }
+            break;
             case 'w': _options.sleep_us        = strtol(optarg, nullptr, 10);   break;
             case 'b': _options.baudrate        = strtoul(optarg, nullptr, 10);  break;
             case 'p': _options.poll_ms         = strtol(optarg, nullptr, 10);   break;
             case 'r': _options.recv_port       = strtoul(optarg, nullptr, 10);  break;
             case 's': _options.send_port       = strtoul(optarg, nullptr, 10);  break;
+            case 'S': _options.stats_file      = optarg;                        break;
             case 'i': if (nullptr != optarg) strcpy(_options.ip, optarg);       break;
+            case 'm': _options.udp_batch_size  = strtoul(optarg, nullptr, 10);  break;
+            case 'u': _options.udp_batch_timeout_us = strtoul(optarg, nullptr, 10); break;
+            case 'l': _options.queue_depth     = strtoul(optarg, nullptr, 10);  break;
+            case 'o': _options.overflow_policy = strcmp(optarg, "newest") == 0?
+                                                 OverflowPolicy::DROP_NEWEST
+                                                :OverflowPolicy::DROP_OLDEST;   break;
+            case 'g': _options.participants    = strtoul(optarg, nullptr, 10);  break;
+            case 'a': _options.publish_threads = strtoul(optarg, nullptr, 10);  break;
+            case 'k': _options.cpus            = parse_list(optarg);            break;
+            case 'y': _options.priorities      = parse_list(optarg);            break;
+            case 'C': _options.topics_config   = optarg;                        break;
+            case 'L': _options.lock_memory     = true;                          break;
+            case 'c': _options.coalesce        = true;                          break;
+            case 'j': _options.pipelined       = true;                          break;
+            case 'x': _options.passthrough     = true;                          break;
+            case 'z': _options.lazy_publishers = true;                          break;
             case 'f': _options.sw_flow_control = true;                          break;
             case 'h': _options.hw_flow_control = true;                          break;
             case 'v': _options.verbose_debug = true;                            break;
@@ -161,58 +383,291 @@ static int parse_options(int argc, char **argv)
             printf("\033[1;33m[   micrortps_agent   ]\tPoll timeout too low, using 1 ms\033[0m");
     }
 
+    if (_options.udp_batch_size < 1) {
+            _options.udp_batch_size = 1;
+            printf("\033[1;33m[   micrortps_agent   ]\tUDP batch size too low, using 1\033[0m");
+    }
+
+    if (_options.queue_depth < 1) {
+            _options.queue_depth = 1;
+            printf("\033[1;33m[   micrortps_agent   ]\tSample queue depth too low, using 1\033[0m");
+    }
+
     if (_options.hw_flow_control && _options.sw_flow_control) {
             printf("\033[0;31m[   micrortps_agent   ]\tHW and SW flow control set. Please set only one or another\033[0m");
             return -1;
     }
 
+    if (MAX_LINKS <= _options.links.size()) {
+            printf("\033[0;31m[   micrortps_agent   ]\tToo many links, at most %d\033[0m\n", MAX_LINKS);
+            return -1;
+    }
+
+    if (!_options.links.empty() && (options::eEventLoops::POLL == _options.event_loop || _options.pipelined)) {
+            printf("\033[0;31m[   micrortps_agent   ]\tSeveral links need the epoll or busy event loop, without -j\033[0m\n");
+            return -1;
+    }
+
     return 0;
 }
 
+static ThreadSetup thread_setup(size_t thread)
+{
+    ThreadSetup setup;
+    if (thread < _options.cpus.size()) setup.cpu = _options.cpus[thread];
+    if (thread < _options.priorities.size()) setup.priority = _options.priorities[thread];
+    return setup;
+}
+
+/* Applies -k and -y to the calling thread */
+static void setup_agent_thread(eThreads thread, const char *name)
+{
+    const ThreadSetup setup = thread_setup(thread);
+    if (!setup_thread(setup))
+    {
+        printf("\033[1;33m[   micrortps_agent   ]\tCould not run the %s on CPU %d at priority %d\033[0m\n",
+               name, setup.cpu, setup.priority);
+    }
+}
+
+/* Applies the -C file to the topics of a link. Its lines are YAML-style "<topic>: <on|off|max rate in Hz>", with #
+   comments, so that the same file can list topics not built into this agent */
+static bool load_topics_config(const char *path, RtpsTopics &topics, bool verbose)
+{
+    FILE *file = fopen(path, "r");
+    if (nullptr == file)
+    {
+        printf("\033[0;31m[   micrortps_agent   ]\tCould not open the topics config '%s' (%d)\033[0m\n", path, errno);
+        return false;
+    }
+
+    char line[256];
+    while (nullptr != fgets(line, sizeof(line), file))
+    {
+        char name[128], value[64];
+        line[strcspn(line, "#\r\n")] = '\0';
+        if (2 != sscanf(line, " %127[^: ] : %63s", name, value)) continue;
+
+        const int topic_ID = topics.getTopicID(name);
+        if (0 > topic_ID)
+        {
+            if (verbose) printf("\033[1;33m[   micrortps_agent   ]\tTopics config: %s is not bridged\033[0m\n", name);
+            continue;
+        }
+
+        if (0 == strcmp(value, "off") || 0 == strcmp(value, "false"))
+        {
+            topics.setTopicEnabled(topic_ID, false);
+        }
+        else
+        {
+            const double max_rate_hz = strtod(value, nullptr);
+            topics.setTopicEnabled(topic_ID, true);
+            topics.setTopicMaxRate(topic_ID, max_rate_hz);
+            if (verbose && 0.0 < max_rate_hz)
+            {
+                printf("[   micrortps_agent   ]\tTopics config: %s at most %.1fHz\n", name, max_rate_hz);
+            }
+        }
+    }
+
+    fclose(file);
+    return true;
+}
+
+/* Writes the stats of every link, as JSON or as Prometheus text */
+static void write_stats(FILE *file, bool json)
+{
+    if (json) fprintf(file, "[");
+
+    for (size_t i = 0; i < n_links; ++i)
+    {
+        const RtpsTopics &topics = links[i].topics;
+        const TopicNames topic_name = [&topics](uint8_t topic_ID) { return topics.getTopicName(topic_ID); };
+
+        if (json)
+        {
+            fprintf(file, (0 == i) ? "\n" : ",\n");
+            write_json(file, *links[i].stats, i, links[i].ns.c_str(), topic_name);
+        }
+        else
+        {
+            write_prometheus(file, *links[i].stats, i, links[i].ns.c_str(), topic_name, 0 == i);
+        }
+    }
+
+    if (json) fprintf(file, "\n]\n");
+}
+
+static bool stats_as_json(const std::string &path)
+{
+    return 5 <= path.size() && 0 == path.compare(path.size() - 5, 5, ".json");
+}
+
+/* Replaces the -S file, renaming a complete one into place so that a reader never sees it half written */
+static bool write_stats_file(const std::string &path)
+{
+    const std::string tmp_path = path + ".tmp";
+    FILE *file = fopen(tmp_path.c_str(), "w");
+    if (nullptr == file) return false;
+
+    write_stats(file, stats_as_json(path));
+    return 0 == fclose(file) && 0 == rename(tmp_path.c_str(), path.c_str());
+}
+
+void stats_signal_handler(int)
+{
+    dump_stats = 1;
+}
+
 void signal_handler(int signum)
 {
    printf("\033[1;33m[   micrortps_agent   ]\tInterrupt signal (%d) received.\033[0m\n", signum);
    running = 0;
-   transport_node->close();
+   for (size_t i = 0; i < n_links; ++i)
+   {
+       if (nullptr != links[i].transport_node) links[i].transport_node->close();
+   }
 }
 
 @[if recv_topics]@
 std::atomic<bool> exit_sender_thread(false);
-std::condition_variable t_send_queue_cv;
-std::mutex t_send_queue_mutex;
-std::queue<uint8_t> t_send_queue;
 
+/* Serialization buffer of the sender: sized for the largest topic sent, unless one of them is unbounded */
+static constexpr size_t SEND_BUFFER_SIZE = (0 < topic_layout::MAX_SEND_SERIALIZED_SIZE &&
+                                            topic_layout::MAX_SEND_SERIALIZED_SIZE < BUFFER_SIZE) ?
+                                           topic_layout::MAX_SEND_SERIALIZED_SIZE : BUFFER_SIZE;
+
+void send_msg(Link &link, uint8_t topic_ID, char data_buffer[], size_t buffer_len)
+{
+    /* the header is sent from its own buffer, so the payload needs no headroom, but the frame must fit the link */
+    const size_t max_payload_len = BUFFER_SIZE - link.transport_node->get_header_length();
+    eprosima::fastcdr::FastBuffer cdrbuffer(data_buffer, (buffer_len < max_payload_len) ? buffer_len : max_payload_len);
+    eprosima::fastcdr::Cdr scdr(cdrbuffer);
+
+    if (link.topics.getMsg(topic_ID, scdr))
+    {
+        TopicStats &topic_stats = link.stats->topics[topic_ID];
+        ssize_t length = link.transport_node->write_payload(topic_ID, data_buffer, scdr.getSerializedDataLength());
+        if (0 < length)
+        {
+            total_sent += length;
+            ++sent;
+            topic_stats.sent.fetch_add(1, std::memory_order_relaxed);
+            topic_stats.sent_bytes.fetch_add(length, std::memory_order_relaxed);
+            topic_stats.receive_to_send.record(link.topics.getMsgReceived());
+        }
+        else
+        {
+            topic_stats.send_dropped.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+}
+
+/* Sender thread of the poll loop, which serves a single link */
 void t_send(void*)
 {
-    char data_buffer[BUFFER_SIZE] = {};
-    uint32_t length = 0;
+    char data_buffer[SEND_BUFFER_SIZE] = {};
+    Link &link = links[0];
+
+    uint8_t topic_ID = 255;
+
+    setup_agent_thread(SENDER_THREAD, "sender");
 
     while (running && !exit_sender_thread.load())
     {
-        std::unique_lock<std::mutex> lk(t_send_queue_mutex);
-        while (t_send_queue.empty() && !exit_sender_thread.load())
+        if (!link.send_queue.pop(topic_ID))
         {
-            t_send_queue_cv.wait(lk);
+            // Nothing left to send for now: push out what a batching transport is still holding
+            link.transport_node->flush();
+            link.send_queue.wait();
+            continue;
         }
-        uint8_t topic_ID = t_send_queue.front();
-        t_send_queue.pop();
-        lk.unlock();
 
-        size_t header_length = transport_node->get_header_length();
-        /* make room for the header to fill in later */
-        eprosima::fastcdr::FastBuffer cdrbuffer(&data_buffer[header_length], sizeof(data_buffer)-header_length);
-        eprosima::fastcdr::Cdr scdr(cdrbuffer);
+        send_msg(link, topic_ID, data_buffer, sizeof(data_buffer));
+    }
+}
 
-        if (topics.getMsg(topic_ID, scdr))
+/* Sends everything queued so far for a link. The event loop calls this from its own thread in place of t_send */
+void send_queued(Link &link)
+{
+    char data_buffer[SEND_BUFFER_SIZE] = {};
+    uint8_t topic_ID = 255;
+
+    link.send_queue.clear();
+
+    // Drain until the queue can be armed empty, so the next push wakes the event loop again
+    do
+    {
+        while (link.send_queue.pop(topic_ID))
         {
-            length = scdr.getSerializedDataLength();
-            if (0 < (length = transport_node->write(topic_ID, data_buffer, length)))
-            {
-                total_sent += length;
-                ++sent;
-            }
+            send_msg(link, topic_ID, data_buffer, sizeof(data_buffer));
+        }
+    } while (!link.send_queue.arm());
+
+    link.transport_node->flush();
+}
+@[end if]@
+@[if send_topics]@
+
+/* Pipelined receive path, for a single link: buffers read from it by t_read, waiting for the frame decoder */
+FramePool link_buffers;
+FrameRing link_ring;
+
+void t_read()
+{
+    char spill[BUFFER_SIZE];
+    Transport_node *transport_node = links[0].transport_node;
+    const int rx_fd = transport_node->get_rx_fd();
+
+    setup_agent_thread(LINK_READER_THREAD, "link reader");
+
+    while (running)
+    {
+        // Wait with a timeout so that a shutdown is noticed on an idle link
+        if (-1 != rx_fd && !transport_node->rx_pending())
+        {
+            struct pollfd pfd = {rx_fd, POLLIN, 0};
+            if (1 > poll(&pfd, 1, WAIT_CNST * 1000)) continue;
+        }
+
+        // Read in place into the buffer handed to the decoder. With none free the decoder is too far behind,
+        // and the bytes are read anyway to keep the link flowing, then dropped
+        const int buffer = link_buffers.acquire();
+        ssize_t len = transport_node->read_raw((-1 != buffer) ? link_buffers.data(buffer) : spill, BUFFER_SIZE);
+        if (-1 != buffer && (1 > len || !link_ring.push(0, buffer, len)))
+        {
+            link_buffers.release(buffer);
+        }
+    }
+}
+
+/* Occupancy and latency of the rings between the receive stages */
+void print_stages(const PublishPool &publish_pool)
+{
+    auto print_ring = [](const char *stage, const FrameRing &ring)
+    {
+        printf("[   micrortps_agent   ]	%s: %lu queued, peak %zu/%zu, waited %.1fus mean %.1fus max, %lu dropped\n",
+               stage, (unsigned long)ring.items(), ring.max_occupancy(), ring.depth(), ring.mean_latency_us(),
+               ring.max_latency_us(), (unsigned long)ring.drops());
+    };
+
+    if (_options.pipelined)
+    {
+        print_ring("link reader -> frame decoder", link_ring);
+        if (0 < link_buffers.exhausted())
+        {
+            printf("[   micrortps_agent   ]\tlink reader: %lu reads dropped with no free buffer\n",
+                   (unsigned long)link_buffers.exhausted());
         }
     }
+
+    for (size_t i = 0; i < publish_pool.writers(); ++i)
+    {
+        char stage[48];
+        snprintf(stage, sizeof(stage), "frame decoder -> publish thread %zu", i);
+        print_ring(stage, publish_pool.ring(i));
+    }
 }
 @[end if]@
 
@@ -224,8 +679,15 @@ int main(int argc, char** argv)
         return -1;
     }
 
+    // Before anything is allocated, so that buffers and thread stacks are locked and faulted in as they are mapped
+    if (_options.lock_memory && !lock_memory())
+    {
+        printf("\033[1;33m[   micrortps_agent   ]\tCould not lock the agent memory (%d)\033[0m\n", errno);
+    }
+
     // register signal SIGINT and signal handler
     signal(SIGINT, signal_handler);
+    signal(SIGUSR1, stats_signal_handler);
 
     printf("\033[0;37m--- MicroRTPS Agent ---\033[0m\n");
     printf("[   micrortps_agent   ]\tStarting link...\n");
@@ -234,7 +696,7 @@ int main(int argc, char** argv)
     {
         case options::eTransports::UART:
         {
-            transport_node = new UART_node(_options.device, _options.baudrate, _options.poll_ms,
+            links[0].transport_node = new UART_node(_options.device, _options.baudrate, _options.poll_ms,
                    _options.sw_flow_control, _options.hw_flow_control, _options.verbose_debug);
             printf("[   micrortps_agent   ]\tUART transport: device: %s; baudrate: %d; sleep: %dus; poll: %dms; flow_control: %s\n",
                    _options.device, _options.baudrate, _options.sleep_us, _options.poll_ms,
@@ -243,61 +705,404 @@ int main(int argc, char** argv)
         break;
         case options::eTransports::UDP:
         {
-            transport_node = new UDP_node(_options.ip, _options.recv_port, _options.send_port, _options.verbose_debug);
-            printf("[   micrortps_agent   ]\tUDP transport: ip address: %s; recv port: %u; send port: %u; sleep: %dus\n",
-                    _options.ip, _options.recv_port, _options.send_port, _options.sleep_us);
+            links[0].transport_node = new UDP_node(_options.ip, _options.recv_port, _options.send_port,
+                   _options.verbose_debug, _options.udp_batch_size, _options.udp_batch_timeout_us);
+            printf("[   micrortps_agent   ]\tUDP transport: ip address: %s; recv port: %u; send port: %u; sleep: %dus; batch: %u (%uus)\n",
+                    _options.ip, _options.recv_port, _options.send_port, _options.sleep_us,
+                    _options.udp_batch_size, _options.udp_batch_timeout_us);
         }
         break;
+#ifdef MICRORTPS_IO_URING
+        case options::eTransports::UART_URING:
+        {
+            links[0].transport_node = new UART_uring_node(_options.device, _options.baudrate, _options.poll_ms,
+                   _options.hw_flow_control, _options.sw_flow_control, _options.verbose_debug, _options.uring_depth);
+            printf("[   micrortps_agent   ]\tUART io_uring transport: device: %s; baudrate: %d; poll: %dms; depth: %u; flow_control: %s\n",
+                   _options.device, _options.baudrate, _options.poll_ms, _options.uring_depth,
+                   _options.sw_flow_control ? "SW enabled" : (_options.hw_flow_control ? "HW enabled" : "No"));
+        }
+        break;
+        case options::eTransports::UDP_URING:
+        {
+            links[0].transport_node = new UDP_uring_node(_options.ip, _options.recv_port, _options.send_port,
+                   _options.verbose_debug, _options.uring_depth);
+            printf("[   micrortps_agent   ]\tUDP io_uring transport: ip address: %s; recv port: %u; send port: %u; depth: %u\n",
+                    _options.ip, _options.recv_port, _options.send_port, _options.uring_depth);
+        }
+        break;
+#endif /* MICRORTPS_IO_URING */
         default:
+            printf("\033[0;31m[   micrortps_agent   ]\tTransport not available in this build\033[0m\n");
             printf("\033[0;37m[   micrortps_agent   ]\tEXITING...\033[0m\n");
         return -1;
     }
 
-    if (0 > transport_node->init())
+    links[0].ns = _options.ns;
+
+    for (const options::link &extra : _options.links)
     {
-        printf("\033[0;37m[   micrortps_agent   ]\tEXITING...\033[0m\n");
-        return -1;
+        Link &link = links[n_links++];
+        link.ns = extra.ns;
+
+        if (options::eTransports::UDP == extra.transport)
+        {
+            link.transport_node = new UDP_node(_options.ip, extra.recv_port, extra.send_port,
+                   _options.verbose_debug, _options.udp_batch_size, _options.udp_batch_timeout_us);
+            printf("[   micrortps_agent   ]\tUDP link: ip address: %s; recv port: %u; send port: %u; namespace: '%s'\n",
+                    _options.ip, extra.recv_port, extra.send_port, extra.ns.c_str());
+        }
+        else
+        {
+            const uint32_t baudrate = extra.baudrate ? extra.baudrate : _options.baudrate;
+            link.transport_node = new UART_node(extra.device.c_str(), baudrate, _options.poll_ms,
+                   _options.sw_flow_control, _options.hw_flow_control, _options.verbose_debug);
+            printf("[   micrortps_agent   ]\tUART link: device: %s; baudrate: %u; namespace: '%s'\n",
+                   extra.device.c_str(), baudrate, extra.ns.c_str());
+        }
+    }
+
+    for (size_t i = 0; i < n_links; ++i)
+    {
+        links[i].stats.reset(new LinkStats());
+        links[i].transport_node->set_rx_drop_counters(&links[i].stats->rx);
+        if (0 > links[i].transport_node->init())
+        {
+            printf("\033[0;37m[   micrortps_agent   ]\tEXITING...\033[0m\n");
+            return -1;
+        }
     }
 
     sleep(1);
 
 @[if send_topics]@
+    PublishPool publish_pool;
     char data_buffer[BUFFER_SIZE] = {};
+    // Frames are decoded straight into the publish pool buffers when there is one, see below
+    char *frame_buffer = data_buffer;
+    size_t frame_buffer_len = BUFFER_SIZE;
     int received = 0, loop = 0;
-    int length = 0, total_read = 0;
+    int total_read = 0;
     bool receiving = false;
-    uint8_t topic_ID = 255;
     std::chrono::time_point<std::chrono::steady_clock> start, end;
+    size_t frame_link = 0; // Link the frames being decoded come from
+    auto on_frame = [&](uint8_t topic_ID, char *payload, size_t length)
+    {
+        TopicStats &topic_stats = links[frame_link].stats->topics[topic_ID];
+        const size_t frame_length = length + links[frame_link].transport_node->get_header_length();
+        ++received;
+        total_read += frame_length;
+        topic_stats.received.fetch_add(1, std::memory_order_relaxed);
+        topic_stats.received_bytes.fetch_add(frame_length, std::memory_order_relaxed);
+
+        // Disabled and decimated topics are dropped before they are deserialized or queued
+        if (!links[frame_link].topics.admitReceived(topic_ID))
+        {
+            topic_stats.dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+@[if timesync_topic]@
+        // Time sync replies are processed on arrival, a queueing delay would skew the offset
 @[end if]@
+        if (0 < publish_pool.writers()@(' && topic_layout::' + timesync_topic + '::id != topic_ID' if timesync_topic else ''))
+        {
+            // The writer takes the buffer as is, the next frame goes to a fresh one
+            if (!publish_pool.submit(topic_ID, length, frame_link))
+            {
+                topic_stats.dropped.fetch_add(1, std::memory_order_relaxed);
+            }
+            frame_buffer = publish_pool.buffer();
+        }
+        else
+        {
+            const auto decoded = std::chrono::steady_clock::now();
+            links[frame_link].topics.publish(topic_ID, payload, length);
+            topic_stats.decode_to_write.record(decoded);
+        }
+    };
 
-    // Init timesync
-    std::shared_ptr<TimeSync> timeSync = std::make_shared<TimeSync>(_options.verbose_debug);
+    // Publish messages received from a link until it has nothing more buffered
+    auto read_link = [&](size_t link)
+    {
+        ssize_t frames = 0;
+        frame_link = link;
+        while (0 < (frames = links[link].transport_node->read_batch(frame_buffer, frame_buffer_len, on_frame)) ||
+               (0 == frames && links[link].transport_node->rx_pending()))
+        {
+            receiving = true;
+            end = std::chrono::steady_clock::now();
+        }
+    };
 
-    topics.set_timesync(timeSync);
+    // Pipelined: decode the bytes the reader thread handed over, until the ring can be armed empty
+    auto drain_link_ring = [&]()
+    {
+        link_ring.clear();
+        do
+        {
+            uint16_t tag;
+            int buffer;
+            size_t length;
+            while (link_ring.pop(tag, buffer, length))
+            {
+                links[0].transport_node->parse_batch(link_buffers.data(buffer), length, frame_buffer, frame_buffer_len,
+                                                     on_frame);
+                link_buffers.release(buffer);
+                receiving = true;
+                end = std::chrono::steady_clock::now();
+            }
+        } while (!link_ring.arm());
+    };
+@[end if]@
+
+    // Init timesync, each link synchronizes with its own client
+    for (size_t i = 0; i < n_links; ++i)
+    {
+        links[i].timesync = std::make_shared<TimeSync>(_options.verbose_debug);
+        links[i].topics.set_timesync(links[i].timesync);
+        links[i].timesync->setThreadInit([]() { setup_agent_thread(TIMESYNC_THREAD, "timesync"); });
+    }
+
+    // The event loop sleeps in epoll_wait on the links, their send queues and the timesync timer
+    const bool event_loop = (options::eEventLoops::POLL != _options.event_loop);
+    // Woken up at least once per stats period when the stats are written to a file
+    const int epoll_timeout_ms = (options::eEventLoops::BUSY == _options.event_loop) ? 0 :
+                                 _options.stats_file.empty() ? WAIT_CNST * 1000 : STATS_PERIOD_MS;
+    int epoll_fd = -1;
+    int timesync_timer_fd = -1;
+
+@[if send_topics]@
+    // Created before the event loop, which waits on the ring
+    if (_options.pipelined)
+    {
+        // Enough buffers for a full ring, the one being read into and the one being decoded
+        link_buffers.init(LINK_RING_DEPTH + 2, BUFFER_SIZE);
+        if (!link_ring.init(LINK_RING_DEPTH))
+        {
+            printf("\033[0;31m[   micrortps_agent   ]\tLink reader setup failed (%d)\033[0m\n", errno);
+            printf("\033[0;37m[   micrortps_agent   ]\tEXITING...\033[0m\n");
+            return -1;
+        }
+    }
 
+@[end if]@
+    if (event_loop)
+    {
+        epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        struct epoll_event ev = {};
+        ev.events = EPOLLIN;
+        bool watched = (0 <= epoll_fd);
+
+        for (size_t i = 0; watched && i < n_links; ++i)
+        {
+@[if send_topics]@
+            ev.data.fd = _options.pipelined ? link_ring.get_fd() : links[i].transport_node->get_rx_fd();
+            watched = watched && (0 == epoll_ctl(epoll_fd, EPOLL_CTL_ADD, ev.data.fd, &ev));
+            links[i].transport_node->set_rx_nonblocking(true);
+@[end if]@
 @[if recv_topics]@
-    topics.init(&t_send_queue_cv, &t_send_queue_mutex, &t_send_queue, _options.ns);
+            ev.data.fd = links[i].send_queue.get_fd();
+            watched = watched && (0 == epoll_ctl(epoll_fd, EPOLL_CTL_ADD, ev.data.fd, &ev));
+@[end if]@
+        }
+
+
+@[if has_timesync]@
+        struct itimerspec period = {};
+        period.it_interval.tv_nsec = TIMESYNC_PERIOD_MS * 1000000L;
+        period.it_value = period.it_interval;
+        timesync_timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        timerfd_settime(timesync_timer_fd, 0, &period, nullptr);
+        ev.data.fd = timesync_timer_fd;
+        watched = watched && (0 == epoll_ctl(epoll_fd, EPOLL_CTL_ADD, ev.data.fd, &ev));
+        for (size_t i = 0; i < n_links; ++i)
+        {
+            links[i].timesync->setExternalTrigger(true);
+        }
+
+@[end if]@
+        if (!watched)
+        {
+            printf("\033[0;31m[   micrortps_agent   ]\tEvent loop setup failed (%d)\033[0m\n", errno);
+            printf("\033[0;37m[   micrortps_agent   ]\tEXITING...\033[0m\n");
+            return -1;
+        }
+        printf("[   micrortps_agent   ]\tEvent loop: %s\n", epoll_timeout_ms ? "epoll" : "busy poll");
+    }
+
+@[if recv_topics]@
+    for (size_t i = 0; i < n_links; ++i)
+    {
+        if (0 < i)
+        {
+            links[i].topics.shareParticipants(links[0].topics);
+        }
+        links[i].topics.init(&links[i].send_queue, links[i].ns, _options.queue_depth, _options.overflow_policy,
+                             _options.coalesce, _options.passthrough, _options.participants,
+                             _options.lazy_publishers);
+        links[i].topics.setStats(links[i].stats.get());
+    }
+@[end if]@
+
+    for (size_t i = 0; i < n_links; ++i)
+    {
+        if (!_options.topics_config.empty() &&
+            !load_topics_config(_options.topics_config.c_str(), links[i].topics, 0 == i))
+        {
+            printf("\033[0;37m[   micrortps_agent   ]\tEXITING...\033[0m\n");
+            shutdown_links();
+            return -1;
+        }
+    }
+@[if send_topics]@
+
+    if (0 < _options.publish_threads)
+    {
+        /* frame buffers sized for the largest topic received, unless one of them is unbounded */
+        constexpr size_t max_payload_len = (0 < topic_layout::MAX_RECV_SERIALIZED_SIZE &&
+                                            topic_layout::MAX_RECV_SERIALIZED_SIZE < BUFFER_SIZE) ?
+                                           topic_layout::MAX_RECV_SERIALIZED_SIZE : BUFFER_SIZE;
+
+        std::vector<ThreadSetup> writer_setups;
+        for (size_t i = FIRST_PUBLISH_THREAD; i < std::max(_options.cpus.size(), _options.priorities.size()); ++i)
+        {
+            writer_setups.push_back(thread_setup(i));
+        }
+
+        if (!publish_pool.start(_options.publish_threads, PUBLISH_QUEUE_DEPTH,
+                                max_payload_len + links[0].transport_node->get_header_length(),
+                                [](uint8_t link, uint8_t topic_ID, char *data, size_t len,
+                                   std::chrono::steady_clock::time_point decoded)
+                                {
+                                    links[link].topics.publish(topic_ID, data, len);
+                                    links[link].stats->topics[topic_ID].decode_to_write.record(decoded);
+                                },
+                                writer_setups))
+        {
+            printf("\033[0;31m[   micrortps_agent   ]\tPublish threads setup failed (%d)\033[0m\n", errno);
+            printf("\033[0;37m[   micrortps_agent   ]\tEXITING...\033[0m\n");
+            shutdown_links();
+            return -1;
+        }
+        printf("[   micrortps_agent   ]\tPublishing from %u writer threads\n", _options.publish_threads);
+        if (!writer_setups.empty())
+        {
+            // Each writer applies its setup as it starts: give them a moment before checking
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            if (0 < publish_pool.setup_failures())
+            {
+                printf("\033[1;33m[   micrortps_agent   ]\tCould not apply -k/-y to %u publish threads\033[0m\n",
+                       publish_pool.setup_failures());
+            }
+        }
+        frame_buffer = publish_pool.buffer();
+        frame_buffer_len = publish_pool.buffer_size();
+    }
 @[end if]@
 
     running = true;
+@[if send_topics]@
+    std::thread reader_thread;
+    if (_options.pipelined)
+    {
+        if (-1 != links[0].transport_node->get_rx_fd())
+        {
+            links[0].transport_node->set_rx_nonblocking(true);
+        }
+        reader_thread = std::thread(t_read);
+        printf("[   micrortps_agent   ]\tPipelined: reading the link on its own thread\n");
+    }
+@[end if]@
 @[if recv_topics]@
-    std::thread sender_thread(t_send, nullptr);
+    std::thread sender_thread;
+    if (!event_loop)
+    {
+        sender_thread = std::thread(t_send, nullptr);
+    }
 @[end if]@
 
+    // The frame decoder runs on this thread. Set up last, so that the threads started above, DDS ones included,
+    // do not inherit its CPU and priority
+    setup_agent_thread(FRAME_DECODER_THREAD, "frame decoder");
+
+    auto stats_written = std::chrono::steady_clock::now();
+
     while (running)
     {
 @[if send_topics]@
         ++loop;
         if (!receiving) start = std::chrono::steady_clock::now();
-        // Publish messages received from UART
-        while (0 < (length = transport_node->read(&topic_ID, data_buffer, BUFFER_SIZE)))
+@[end if]@
+        if (event_loop)
         {
-            topics.publish(topic_ID, data_buffer, sizeof(data_buffer));
-            ++received;
-            total_read += length;
-            receiving = true;
-            end = std::chrono::steady_clock::now();
+            struct epoll_event events[2 * MAX_LINKS + 1];
+            int n_events = epoll_wait(epoll_fd, events, 2 * MAX_LINKS + 1, epoll_timeout_ms);
+
+            for (int i = 0; i < n_events; ++i)
+            {
+                const int fd = events[i].data.fd;
+
+                if (fd == timesync_timer_fd)
+                {
+                    uint64_t expirations = 0;
+                    ssize_t ret = read(timesync_timer_fd, &expirations, sizeof(expirations));
+                    (void)ret;
+                    for (size_t l = 0; l < n_links; ++l)
+                    {
+                        links[l].timesync->sendTimesync();
+                    }
+                    continue;
+                }
+@[if send_topics]@
+                if (_options.pipelined && fd == link_ring.get_fd())
+                {
+                    drain_link_ring();
+                    continue;
+                }
+@[end if]@
+
+                // Otherwise the send queue or the receive side of a link
+                for (size_t l = 0; l < n_links; ++l)
+                {
+@[if recv_topics]@
+                    if (fd == links[l].send_queue.get_fd())
+                    {
+                        send_queued(links[l]);
+                        break;
+                    }
+@[end if]@
+@[if send_topics]@
+                    if (fd == links[l].transport_node->get_rx_fd())
+                    {
+                        read_link(l);
+                        break;
+                    }
+@[end if]@
+                }
+            }
+        }
+        else
+        {
+@[if send_topics]@
+            if (_options.pipelined)
+            {
+                link_ring.wait(_options.poll_ms);
+                drain_link_ring();
+            }
+            else
+            {
+                // Publish messages received from UART, draining every frame buffered by each read
+                while (0 < links[0].transport_node->read_batch(frame_buffer, frame_buffer_len, on_frame))
+                {
+                    receiving = true;
+                    end = std::chrono::steady_clock::now();
+                }
+            }
+@[else]@
+            usleep(_options.sleep_us);
+@[end if]@
         }
+@[if send_topics]@
 
         if ((receiving && std::chrono::duration<double>(std::chrono::steady_clock::now() - end).count() > WAIT_CNST) ||
             (!running  && loop > 1))
@@ -306,23 +1111,60 @@ int main(int argc, char** argv)
             printf("[   micrortps_agent   ]\tSENT:     %lumessages \t- %lubytes\n", (unsigned long)sent, (unsigned long)total_sent);
             printf("[   micrortps_agent   ]\tRECEIVED: %dmessages \t- %dbytes; %d LOOPS - %.03f seconds - %.02fKB/s\n",
                     received, total_read, loop, elapsed_secs.count(), (double)total_read/(1000*elapsed_secs.count()));
+            print_stages(publish_pool);
             received = sent = total_read = total_sent = 0;
             receiving = false;
         }
-@[else]@
-        usleep(_options.sleep_us);
 @[end if]@
+
+        if (dump_stats)
+        {
+            dump_stats = 0;
+            write_stats(stdout, stats_as_json(_options.stats_file));
+            fflush(stdout);
+        }
+
+        if (!_options.stats_file.empty() && std::chrono::steady_clock::now() - stats_written >=
+                                            std::chrono::milliseconds(STATS_PERIOD_MS))
+        {
+            stats_written = std::chrono::steady_clock::now();
+            if (!write_stats_file(_options.stats_file) && _options.verbose_debug)
+            {
+                printf("\033[1;33m[   micrortps_agent   ]\tCould not write the stats to '%s' (%d)\033[0m\n",
+                       _options.stats_file.c_str(), errno);
+            }
+        }
+    }
+@[if send_topics]@
+    if (reader_thread.joinable())
+    {
+        reader_thread.join();
+    }
+    publish_pool.stop();
+    if (0 < publish_pool.overflows())
+    {
+        printf("\033[1;33m[   micrortps_agent   ]\t%lu received samples dropped on a full publish queue\033[0m\n",
+               (unsigned long)publish_pool.overflows());
+    }
+@[end if]@
+@[if recv_topics]@
+    if (sender_thread.joinable())
+    {
+        exit_sender_thread = true;
+        links[0].send_queue.wake();
+        sender_thread.join();
     }
+@[end if]@
 @[if recv_topics]@
-    exit_sender_thread = true;
-    t_send_queue_cv.notify_one();
-    sender_thread.join();
+    for (size_t i = 0; i < n_links; ++i)
+    {
+        links[i].topics.printOverflows();
+    }
 @[end if]@
-    delete transport_node;
-    transport_node = nullptr;
+    shutdown_links();
 
-    timeSync->stop();
-    timeSync->reset();
+    if (-1 != timesync_timer_fd) close(timesync_timer_fd);
+    if (-1 != epoll_fd) close(epoll_fd);
 
     return 0;
 }
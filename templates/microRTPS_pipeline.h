@@ -0,0 +1,554 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2020 PX4 Development Team. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/*!
+ * @file microRTPS_pipeline.h
+ * @brief Buffers, rings and threads connecting the stages of the agent receive path: link reader, frame decoder and
+ *        DDS writers
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <malloc.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "microRTPS_send_queue.h"
+
+/**
+ * Arena of fixed-size buffers handed down the receive pipeline by index, so that a stage fills a buffer in place and
+ * the next one works on it where it is. A buffer has a single owner at a time: the stage that acquired it, then the
+ * one it was passed to, which releases it when done. Nothing is allocated after init().
+ */
+class FramePool
+{
+public:
+	/** Most buffers a pool can hold, the capacity of its free list */
+	static constexpr size_t MAX_BUFFERS = 1024;
+
+	FramePool() = default;
+
+	FramePool(const FramePool &) = delete;
+	FramePool &operator=(const FramePool &) = delete;
+
+	/**
+	 * Allocates the buffers. Not thread safe, call before any acquire
+	 * @param buffers number of buffers, at most MAX_BUFFERS
+	 * @param buffer_size size of each buffer
+	 */
+	void init(size_t buffers, size_t buffer_size)
+	{
+		buffers = std::min(buffers, MAX_BUFFERS);
+		_data.reset(new char[buffers * buffer_size]);
+		_buffer_size = buffer_size;
+
+		for (size_t i = 0; i < buffers; ++i) {
+			_free.push((uint16_t)i);
+		}
+	}
+
+	/**
+	 * Takes a free buffer. A single thread per pool may acquire
+	 * @return the buffer index, -1 if all of them are in use
+	 */
+	int acquire()
+	{
+		uint16_t index;
+
+		if (!_free.pop(index)) {
+			_exhausted.fetch_add(1, std::memory_order_relaxed);
+			return -1;
+		}
+
+		return index;
+	}
+
+	/** Returns a buffer to the pool. Safe from any number of threads */
+	void release(int index)
+	{
+		_free.push((uint16_t)index);
+	}
+
+	char *data(int index) { return _data.get() + (size_t)index * _buffer_size; }
+
+	size_t buffer_size() const { return _buffer_size; }
+
+	/** Times acquire() found no free buffer */
+	uint64_t exhausted() const { return _exhausted.load(std::memory_order_relaxed); }
+
+private:
+	MPSCQueue<uint16_t, MAX_BUFFERS> _free;
+	std::unique_ptr<char[]> _data;
+	size_t _buffer_size{0};
+	std::atomic<uint64_t> _exhausted{0};
+};
+
+/**
+ * Bounded single-producer/single-consumer ring of FramePool buffers, each tagged with an ID, between two pipeline
+ * stages. Items are buffer indices: the payload itself is never copied by the ring.
+ *
+ * A full ring refuses the new item rather than making the producer wait. Like SendQueue, a consumer about to sleep
+ * announces it with arm(), and only then does the producer pay for the eventfd write that wakes it, so get_fd()
+ * can also be waited on in an event loop.
+ *
+ * The ring records its peak occupancy and the time items spent queued, which is how far the consumer stage lags.
+ */
+class FrameRing
+{
+public:
+	FrameRing() = default;
+
+	~FrameRing()
+	{
+		if (-1 != _fd) {
+			::close(_fd);
+		}
+	}
+
+	FrameRing(const FrameRing &) = delete;
+	FrameRing &operator=(const FrameRing &) = delete;
+
+	/**
+	 * Allocates the ring. Not thread safe, call before any push
+	 * @param depth number of items, rounded up to a power of two
+	 * @return false if the wakeup eventfd could not be created
+	 */
+	bool init(size_t depth)
+	{
+		size_t size = 1;
+
+		while (size < depth) {
+			size <<= 1;
+		}
+
+		_items.reset(new Item[size]);
+		_mask = size - 1;
+		_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		return -1 != _fd;
+	}
+
+	/**
+	 * Queues a filled buffer. Producer thread only
+	 * @return false if the ring is full, in which case the buffer stays with the caller
+	 */
+	bool push(uint16_t tag, int buffer, size_t len)
+	{
+		const size_t head = _head.load(std::memory_order_relaxed);
+		const size_t occupancy = head - _tail.load(std::memory_order_acquire);
+
+		if (occupancy > _mask) {
+			_drops.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+
+		Item &item = _items[head & _mask];
+		item.tag = tag;
+		item.buffer = buffer;
+		item.len = len;
+		item.queued = std::chrono::steady_clock::now();
+		_head.store(head + 1, std::memory_order_release);
+
+		if (occupancy + 1 > _max_occupancy.load(std::memory_order_relaxed)) {
+			_max_occupancy.store(occupancy + 1, std::memory_order_relaxed);
+		}
+
+		// Pairs with the fence in arm(): either the consumer sees the new item or we see it waiting
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+
+		if (_waiting.load(std::memory_order_relaxed) && _waiting.exchange(false, std::memory_order_acq_rel)) {
+			wake();
+		}
+
+		return true;
+	}
+
+	/**
+	 * Takes the oldest item, whose buffer then belongs to the caller. Consumer thread only
+	 * @param queued if not nullptr, set to when the item was pushed
+	 * @return false if the ring is empty
+	 */
+	bool pop(uint16_t &tag, int &buffer, size_t &len, std::chrono::steady_clock::time_point *queued = nullptr)
+	{
+		const size_t tail = _tail.load(std::memory_order_relaxed);
+
+		if (tail == _head.load(std::memory_order_acquire)) {
+			return false;
+		}
+
+		const Item &item = _items[tail & _mask];
+		tag = item.tag;
+		buffer = item.buffer;
+		len = item.len;
+
+		if (queued) {
+			*queued = item.queued;
+		}
+
+		const uint64_t latency_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+						    std::chrono::steady_clock::now() - item.queued).count();
+		_popped.fetch_add(1, std::memory_order_relaxed);
+		_latency_ns_sum.fetch_add(latency_ns, std::memory_order_relaxed);
+
+		if (latency_ns > _latency_ns_max.load(std::memory_order_relaxed)) {
+			_latency_ns_max.store(latency_ns, std::memory_order_relaxed);
+		}
+
+		_tail.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+
+	/** Consumer thread only */
+	bool empty() const { return _tail.load(std::memory_order_relaxed) == _head.load(std::memory_order_acquire); }
+
+	/**
+	 * Announces that the consumer is about to sleep on get_fd(), so the next push signals it. Consumer thread only
+	 * @return false if items are already queued, in which case the consumer should drain instead of sleeping
+	 */
+	bool arm()
+	{
+		_waiting.store(true, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+
+		if (!empty()) {
+			_waiting.store(false, std::memory_order_relaxed);
+			return false;
+		}
+
+		return true;
+	}
+
+	/**
+	 * Blocks the consumer until an item is queued or wake() is called
+	 * @param timeout_ms longest wait, -1 for no limit
+	 */
+	void wait(int timeout_ms = -1)
+	{
+		if (arm()) {
+			struct pollfd pfd = {_fd, POLLIN, 0};
+			poll(&pfd, 1, timeout_ms);
+		}
+
+		clear();
+	}
+
+	/** Wakes the consumer, e.g. to have it notice a shutdown request */
+	void wake()
+	{
+		uint64_t one = 1;
+		ssize_t ret = ::write(_fd, &one, sizeof(one));
+		(void)ret;
+	}
+
+	/** Resets the wakeup after the consumer woke up on get_fd() */
+	void clear()
+	{
+		uint64_t count;
+		ssize_t ret = ::read(_fd, &count, sizeof(count));
+		(void)ret;
+	}
+
+	/** eventfd that becomes readable when an armed consumer should wake up */
+	int get_fd() const { return _fd; }
+
+	/** Items refused because the ring was full */
+	uint64_t drops() const { return _drops.load(std::memory_order_relaxed); }
+
+	/** Items taken by the consumer so far */
+	uint64_t items() const { return _popped.load(std::memory_order_relaxed); }
+
+	/** Most items queued at once */
+	size_t max_occupancy() const { return _max_occupancy.load(std::memory_order_relaxed); }
+
+	size_t depth() const { return _mask + 1; }
+
+	/** Mean and longest time an item waited for the consumer, in microseconds */
+	double mean_latency_us() const
+	{
+		const uint64_t items = _popped.load(std::memory_order_relaxed);
+		return items ? _latency_ns_sum.load(std::memory_order_relaxed) / (1000.0 * items) : 0.0;
+	}
+
+	double max_latency_us() const { return _latency_ns_max.load(std::memory_order_relaxed) / 1000.0; }
+
+private:
+	struct Item {
+		uint16_t tag;
+		int buffer;
+		size_t len;
+		std::chrono::steady_clock::time_point queued;
+	};
+
+	std::unique_ptr<Item[]> _items;
+	size_t _mask{0};
+	int _fd{-1};
+	std::atomic<bool> _waiting{true};
+
+	// Producer and consumer indices a cache line apart. Padded rather than aligned: rings are heap allocated,
+	// and over-aligned new needs C++17
+	std::atomic<size_t> _head{0};
+	char _pad[64 - sizeof(std::atomic<size_t>)];
+	std::atomic<size_t> _tail{0};
+
+	// Written by the producer
+	std::atomic<uint64_t> _drops{0};
+	std::atomic<size_t> _max_occupancy{0};
+
+	// Written by the consumer
+	std::atomic<uint64_t> _popped{0};
+	std::atomic<uint64_t> _latency_ns_sum{0};
+	std::atomic<uint64_t> _latency_ns_max{0};
+};
+
+/**
+ * Pins the calling thread to a CPU
+ * @param cpu CPU number, <0 to leave the thread unpinned
+ * @return false if the affinity could not be set
+ */
+inline bool pin_thread(int cpu)
+{
+	if (cpu < 0) {
+		return true;
+	}
+
+	cpu_set_t cpus;
+	CPU_ZERO(&cpus);
+	CPU_SET(cpu, &cpus);
+	return 0 == pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+}
+
+/** Where and how a thread of the agent runs */
+struct ThreadSetup {
+	int cpu{-1};     ///< CPU to pin the thread to, <0 to leave it unpinned
+	int priority{0}; ///< SCHED_FIFO priority, 0 to keep the default scheduler
+};
+
+/** Stack touched by setup_thread() for a real-time thread, so that it does not page fault on its first frames */
+static constexpr size_t PREFAULT_STACK_SIZE = 64 * 1024;
+
+/**
+ * Applies a ThreadSetup to the calling thread. Real-time priorities need CAP_SYS_NICE or an RLIMIT_RTPRIO allowing
+ * them, and should go with lock_memory()
+ * @return false if the affinity or the priority could not be set
+ */
+inline bool setup_thread(const ThreadSetup &setup)
+{
+	bool ok = pin_thread(setup.cpu);
+
+	if (0 < setup.priority) {
+		struct sched_param param = {};
+		param.sched_priority = std::min(setup.priority, sched_get_priority_max(SCHED_FIFO));
+		ok = (0 == pthread_setschedparam(pthread_self(), SCHED_FIFO, &param)) && ok;
+
+		volatile char stack[PREFAULT_STACK_SIZE];
+		memset((char *)stack, 0, sizeof(stack));
+	}
+
+	return ok;
+}
+
+/**
+ * Locks the pages of the process, current and future, into memory, and keeps freed heap memory mapped, so that
+ * no page fault or swap-in stalls a thread once it runs. Call early: thread stacks and buffers allocated
+ * afterwards are faulted in as they are mapped
+ * @return false if the memory could not be locked, e.g. over RLIMIT_MEMLOCK
+ */
+inline bool lock_memory()
+{
+	if (0 != mlockall(MCL_CURRENT | MCL_FUTURE)) {
+		return false;
+	}
+
+	// Neither trim the heap nor serve allocations from mmap, which would be faulted in again on each allocation
+	mallopt(M_TRIM_THRESHOLD, -1);
+	mallopt(M_MMAP_MAX, 0);
+	return true;
+}
+
+/**
+ * Hands the frames decoded from the link over to a few writer threads, which deserialize and publish them, so that
+ * a slow DDS write (e.g. a reliable publisher waiting for a lagging reader) never holds up the receive path.
+ *
+ * The decoder decodes each frame straight into buffer(), a FramePool buffer that submit() then passes to the writer
+ * of the topic without copying it; the writer gives it back to the pool once published. Topics are sharded over the
+ * writers by link and ID, which keeps the samples of a topic in order and its publisher on a single thread.
+ */
+class PublishPool
+{
+public:
+	/** Publishes one frame, submitted at decoded, called from the writer thread of its topic */
+	using Handler = std::function<void(uint8_t link, uint8_t topic_ID, char *data, size_t len,
+					   std::chrono::steady_clock::time_point decoded)>;
+
+	PublishPool() = default;
+	~PublishPool() { stop(); }
+
+	PublishPool(const PublishPool &) = delete;
+	PublishPool &operator=(const PublishPool &) = delete;
+
+	/**
+	 * Starts the writer threads. Not thread safe, call before any submit
+	 * @param writers number of writer threads, 0 to leave the pool stopped
+	 * @param depth frames queued per writer, rounded up to a power of two
+	 * @param buffer_size size of the frame buffers, as passed to the transport decoding into them
+	 * @param setups how to run the writers, in turn, none to leave them as started
+	 * @return false if a writer could not be set up
+	 */
+	bool start(size_t writers, size_t depth, size_t buffer_size, Handler handler,
+		   const std::vector<ThreadSetup> &setups = {})
+	{
+		_handler = handler;
+		_running.store(true, std::memory_order_relaxed);
+
+		for (size_t i = 0; i < writers; ++i) {
+			std::unique_ptr<FrameRing> ring(new FrameRing());
+
+			if (!ring->init(depth)) {
+				_rings.clear();
+				return false;
+			}
+
+			_rings.push_back(std::move(ring));
+		}
+
+		// Enough buffers for full rings, the one being decoded into and one being published by each writer
+		_buffers.init(writers * (_rings.empty() ? 0 : _rings[0]->depth() + 1) + 1, buffer_size);
+		_spill.reset(new char[buffer_size]);
+		_current = _buffers.acquire();
+
+		for (size_t i = 0; i < writers; ++i) {
+			const ThreadSetup setup = setups.empty() ? ThreadSetup() : setups[i % setups.size()];
+			_threads.push_back(std::thread(&PublishPool::run, this, _rings[i].get(), setup));
+		}
+
+		return true;
+	}
+
+	/** Buffer to decode the next frame into, buffer_size() long. Decoder thread only */
+	char *buffer() { return (-1 != _current) ? _buffers.data(_current) : _spill.get(); }
+
+	size_t buffer_size() const { return _buffers.buffer_size(); }
+
+	/**
+	 * Hands the frame decoded into buffer() to the writer of its topic. buffer() changes if it succeeds.
+	 * Decoder thread only
+	 * @param link index of the link the frame came from, passed on to the handler
+	 * @return false if the frame was dropped because the writer is too far behind
+	 */
+	bool submit(uint8_t topic_ID, size_t len, uint8_t link = 0)
+	{
+		if (-1 == _current) {
+			// Every buffer was queued or being published, so the frame went to the spill buffer
+			_overflows.fetch_add(1, std::memory_order_relaxed);
+			_current = _buffers.acquire();
+			return false;
+		}
+
+		if (!_rings[(topic_ID + link) % _rings.size()]->push((uint16_t)(link << 8 | topic_ID), _current, len)) {
+			_overflows.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+
+		_current = _buffers.acquire();
+		return true;
+	}
+
+	/** Stops and joins the writers, dropping the frames they did not publish yet. The rings stay readable */
+	void stop()
+	{
+		_running.store(false, std::memory_order_relaxed);
+
+		for (size_t i = 0; i < _threads.size(); ++i) {
+			_rings[i]->wake();
+
+			if (_threads[i].joinable()) {
+				_threads[i].join();
+			}
+		}
+	}
+
+	size_t writers() const { return _rings.size(); }
+
+	const FrameRing &ring(size_t writer) const { return *_rings[writer]; }
+
+	/** Frames dropped because their writer was too far behind */
+	uint64_t overflows() const { return _overflows.load(std::memory_order_relaxed); }
+
+	/** Writers whose ThreadSetup could not be applied */
+	uint32_t setup_failures() const { return _setup_failures.load(std::memory_order_relaxed); }
+
+private:
+	void run(FrameRing *ring, ThreadSetup setup)
+	{
+		uint16_t tag;
+		int buffer;
+		size_t len;
+		std::chrono::steady_clock::time_point decoded;
+
+		if (!setup_thread(setup)) {
+			_setup_failures.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		while (_running.load(std::memory_order_relaxed)) {
+			if (!ring->pop(tag, buffer, len, &decoded)) {
+				ring->wait();
+				continue;
+			}
+
+			_handler(tag >> 8, tag & 0xff, _buffers.data(buffer), len, decoded);
+			_buffers.release(buffer);
+		}
+	}
+
+	std::vector<std::unique_ptr<FrameRing>> _rings;
+	std::vector<std::thread> _threads;
+	FramePool _buffers;
+	std::unique_ptr<char[]> _spill;
+	int _current{-1};
+	Handler _handler;
+	std::atomic<uint64_t> _overflows{0};
+	std::atomic<uint32_t> _setup_failures{0};
+	std::atomic<bool> _running{false};
+};
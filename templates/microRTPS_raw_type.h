@@ -0,0 +1,112 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2020 PX4 Development Team. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+/*!
+ * @file microRTPS_raw_type.h
+ * @brief DDS type that publishes CDR payloads as they arrive from the link
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <functional>
+
+#include <fastcdr/Cdr.h>
+#include <fastrtps/TopicDataType.h>
+
+/** A CDR payload, as received from the client without encapsulation */
+struct RawSample {
+	const char *data;
+	uint32_t length;
+};
+
+/**
+ * Stands in for the generated PubSubType of a topic: same type name and maximum size, but writing a RawSample
+ * copies its bytes behind the encapsulation header instead of serializing a message.
+ * The client serializes with the same CDR rules as the generated type, so subscribers cannot tell the difference.
+ */
+template <class T_datatype>
+class RawPubSubType : public eprosima::fastrtps::TopicDataType
+{
+public:
+	RawPubSubType()
+	{
+		T_datatype type;
+		setName(type.getName());
+		m_typeSize = type.m_typeSize;
+		m_isGetKeyDefined = false;
+	}
+
+	bool serialize(void *data, eprosima::fastrtps::rtps::SerializedPayload_t *payload) override
+	{
+		const RawSample *sample = static_cast<const RawSample *>(data);
+
+		if (ENCAPSULATION_SIZE + sample->length > payload->max_size) {
+			return false;
+		}
+
+		// Same header as Cdr::serialize_encapsulation(): the payload keeps the host byte order it was decoded in
+		payload->encapsulation = (eprosima::fastcdr::Cdr::DEFAULT_ENDIAN == eprosima::fastcdr::Cdr::BIG_ENDIANNESS) ?
+					 CDR_BE : CDR_LE;
+		payload->data[0] = 0;
+		payload->data[1] = (eprosima::fastrtps::rtps::octet)payload->encapsulation;
+		payload->data[2] = 0;
+		payload->data[3] = 0;
+		memcpy(payload->data + ENCAPSULATION_SIZE, sample->data, sample->length);
+		payload->length = ENCAPSULATION_SIZE + sample->length;
+		return true;
+	}
+
+	bool deserialize(eprosima::fastrtps::rtps::SerializedPayload_t *, void *) override
+	{
+		// Publish only
+		return false;
+	}
+
+	std::function<uint32_t()> getSerializedSizeProvider(void *data) override
+	{
+		return [data]() -> uint32_t {
+			return ENCAPSULATION_SIZE + static_cast<const RawSample *>(data)->length;
+		};
+	}
+
+	void *createData() override { return new RawSample(); }
+
+	void deleteData(void *data) override { delete static_cast<RawSample *>(data); }
+
+	bool getKey(void *, eprosima::fastrtps::rtps::InstanceHandle_t *, bool) override { return false; }
+
+private:
+	static constexpr uint32_t ENCAPSULATION_SIZE = 4;
+};
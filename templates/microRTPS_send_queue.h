@@ -0,0 +1,477 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2020 PX4 Development Team. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/*!
+ * @file microRTPS_send_queue.h
+ * @brief Lock-free queues of the samples and topics waiting to be sent over the link
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+/**
+ * Bounded lock-free multi-producer/single-consumer queue (array of sequenced cells, after D. Vyukov).
+ * Producers never take a lock
+ */
+template <typename T, size_t N>
+class MPSCQueue
+{
+	static_assert((N & (N - 1)) == 0, "MPSCQueue size must be a power of two");
+
+public:
+	MPSCQueue()
+	{
+		for (size_t i = 0; i < N; ++i) {
+			_cells[i].seq.store(i, std::memory_order_relaxed);
+		}
+	}
+
+	MPSCQueue(const MPSCQueue &) = delete;
+	MPSCQueue &operator=(const MPSCQueue &) = delete;
+
+	/**
+	 * Enqueues a value. Safe from any number of threads
+	 * @return false if the queue is full
+	 */
+	bool push(const T &value)
+	{
+		size_t pos = _enqueue_pos.load(std::memory_order_relaxed);
+		Cell *cell;
+
+		for (;;) {
+			cell = &_cells[pos & (N - 1)];
+			intptr_t diff = (intptr_t)cell->seq.load(std::memory_order_acquire) - (intptr_t)pos;
+
+			if (0 == diff) {
+				if (_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+					break;
+				}
+
+			} else if (diff < 0) {
+				return false;
+
+			} else {
+				pos = _enqueue_pos.load(std::memory_order_relaxed);
+			}
+		}
+
+		cell->value = value;
+		cell->seq.store(pos + 1, std::memory_order_release);
+		return true;
+	}
+
+	/**
+	 * Dequeues the oldest value. Consumer thread only
+	 * @return false if the queue is empty
+	 */
+	bool pop(T &value)
+	{
+		Cell *cell = &_cells[_dequeue_pos & (N - 1)];
+
+		if (cell->seq.load(std::memory_order_acquire) != _dequeue_pos + 1) {
+			return false;
+		}
+
+		value = cell->value;
+		cell->seq.store(_dequeue_pos + N, std::memory_order_release);
+		++_dequeue_pos;
+		return true;
+	}
+
+	/** Consumer thread only */
+	bool empty() const
+	{
+		return _cells[_dequeue_pos & (N - 1)].seq.load(std::memory_order_acquire) != _dequeue_pos + 1;
+	}
+
+private:
+	struct Cell {
+		std::atomic<size_t> seq;
+		T value;
+	};
+
+	// Producer and consumer indices on their own cache lines
+	alignas(64) Cell _cells[N];
+	alignas(64) std::atomic<size_t> _enqueue_pos{0};
+	alignas(64) size_t _dequeue_pos{0};
+};
+
+/** What a full SampleRing gives up to make room */
+enum class OverflowPolicy {
+	DROP_OLDEST,
+	DROP_NEWEST
+};
+
+/**
+ * Fixed-depth ring of samples between one DDS listener thread (producer) and the sender (consumer), so that the
+ * listener never waits for the link. Built like MPSCQueue, except that the read index is also claimed with a CAS:
+ * with OverflowPolicy::DROP_OLDEST the producer discards the oldest sample itself when the ring is full.
+ *
+ * Samples are swapped in and out rather than copied, so the storage of their strings and sequences circulates
+ * between the producer, the ring and the consumer instead of being reallocated for each sample.
+ */
+template <typename T>
+class SampleRing
+{
+public:
+	SampleRing() = default;
+
+	SampleRing(const SampleRing &) = delete;
+	SampleRing &operator=(const SampleRing &) = delete;
+
+	/**
+	 * Allocates the ring. Not thread safe, call before any push
+	 * @param depth number of samples held, rounded up to a power of two
+	 */
+	void init(size_t depth, OverflowPolicy policy)
+	{
+		size_t size = 1;
+
+		while (size < depth) {
+			size <<= 1;
+		}
+
+		_depth = size;
+
+		// A single cell could not tell the sample it holds from the free cell of the next lap by its sequence, so a
+		// single sample ring gets two, and try_push() stops at one
+		if (size < 2) {
+			size = 2;
+		}
+
+		_cells.reset(new Cell[size]);
+		_mask = size - 1;
+		_policy = policy;
+
+		for (size_t i = 0; i < size; ++i) {
+			_cells[i].seq.store(i, std::memory_order_relaxed);
+		}
+
+		_enqueue_pos.store(0, std::memory_order_relaxed);
+		_dequeue_pos.store(0, std::memory_order_relaxed);
+	}
+
+	/**
+	 * Queues a sample, dropping one according to the policy if the ring is full. Producer thread only
+	 * @param value sample to queue, left holding a consumed sample to be overwritten
+	 * @return false if the sample itself was dropped
+	 */
+	bool push(T &value)
+	{
+		if (try_push(value)) {
+			return true;
+		}
+
+		if (OverflowPolicy::DROP_OLDEST == _policy) {
+			// Fails only if the consumer took the oldest sample meanwhile, which makes room all the same
+			if (try_pop(_dropped)) {
+				_overflows.fetch_add(1, std::memory_order_relaxed);
+			}
+
+			// Fails only while the consumer is still copying out the oldest sample: then the new one goes instead
+			if (try_push(value)) {
+				return true;
+			}
+		}
+
+		_overflows.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+
+	/**
+	 * Takes the oldest sample. Consumer thread only
+	 * @param value set to the sample, its previous contents are recycled by the ring
+	 * @param queued if not nullptr, set to when the sample was pushed
+	 * @return false if the ring is empty
+	 */
+	bool pop(T &value, std::chrono::steady_clock::time_point *queued = nullptr)
+	{
+		return try_pop(value, queued);
+	}
+
+	/** Consumer thread only */
+	bool empty() const
+	{
+		const size_t pos = _dequeue_pos.load(std::memory_order_relaxed);
+		return _cells[pos & _mask].seq.load(std::memory_order_acquire) != pos + 1;
+	}
+
+	/** Samples dropped because the ring was full */
+	uint64_t overflows() const { return _overflows.load(std::memory_order_relaxed); }
+
+	size_t depth() const { return _depth; }
+
+private:
+	struct Cell {
+		std::atomic<size_t> seq;
+		std::chrono::steady_clock::time_point queued;
+		T value;
+	};
+
+	bool try_push(T &value)
+	{
+		const size_t pos = _enqueue_pos.load(std::memory_order_relaxed);
+		Cell *cell = &_cells[pos & _mask];
+
+		if (cell->seq.load(std::memory_order_acquire) != pos) {
+			return false;
+		}
+
+		if (_depth <= _mask && pos - _dequeue_pos.load(std::memory_order_acquire) >= _depth) {
+			return false;
+		}
+
+		// Swapped rather than moved, so the caller gets the storage of a consumed sample back to fill again
+		std::swap(cell->value, value);
+		cell->queued = std::chrono::steady_clock::now();
+		_enqueue_pos.store(pos + 1, std::memory_order_relaxed);
+		cell->seq.store(pos + 1, std::memory_order_release);
+		return true;
+	}
+
+	bool try_pop(T &value, std::chrono::steady_clock::time_point *queued = nullptr)
+	{
+		size_t pos = _dequeue_pos.load(std::memory_order_relaxed);
+		Cell *cell;
+
+		for (;;) {
+			cell = &_cells[pos & _mask];
+			intptr_t diff = (intptr_t)cell->seq.load(std::memory_order_acquire) - (intptr_t)(pos + 1);
+
+			if (0 == diff) {
+				if (_dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+					break;
+				}
+
+			} else if (diff < 0) {
+				return false;
+
+			} else {
+				pos = _dequeue_pos.load(std::memory_order_relaxed);
+			}
+		}
+
+		std::swap(value, cell->value);
+
+		if (queued) {
+			*queued = cell->queued;
+		}
+
+		cell->seq.store(pos + _mask + 1, std::memory_order_release);
+		return true;
+	}
+
+	std::unique_ptr<Cell[]> _cells;
+	size_t _mask{0};
+	size_t _depth{0};
+	OverflowPolicy _policy{OverflowPolicy::DROP_OLDEST};
+	T _dropped; // Oldest sample evicted by the producer
+	alignas(64) std::atomic<size_t> _enqueue_pos{0};
+	alignas(64) std::atomic<size_t> _dequeue_pos{0};
+	std::atomic<uint64_t> _overflows{0};
+};
+
+/**
+ * Topic IDs of received DDS samples waiting to be sent over the link, fed by the subscriber listeners and drained
+ * by a single sender.
+ *
+ * Topics are either queued with push(), or, in coalescing mode, flagged with mark() in a dirty bitmap so that a
+ * topic is pending at most once however many times it is marked. Queued samples are popped first;
+ * dirty topics are then handed out one sweep at a time, lowest topic ID first, and a topic marked again during a
+ * sweep waits for the next one so that busy low IDs cannot starve the others.
+ *
+ * A consumer about to sleep announces it with arm(), and only then does a producer pay for the eventfd write that
+ * wakes it, so get_fd() can also be waited on in an event loop.
+ */
+class SendQueue
+{
+public:
+	SendQueue()
+	{
+		_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	}
+
+	~SendQueue()
+	{
+		if (-1 != _fd) {
+			::close(_fd);
+		}
+	}
+
+	SendQueue(const SendQueue &) = delete;
+	SendQueue &operator=(const SendQueue &) = delete;
+
+	/**
+	 * Queues one sample of a topic. Safe from any number of threads
+	 * @return false if the queue is full and the sample was not queued
+	 */
+	bool push(const uint8_t topic_ID)
+	{
+		const bool ret = _fifo.push(topic_ID);
+		signal();
+		return ret;
+	}
+
+	/**
+	 * Flags a topic as having a fresh latest value. Safe from any number of threads, never fails
+	 */
+	void mark(const uint8_t topic_ID)
+	{
+		_dirty[topic_ID >> 6].fetch_or(1ULL << (topic_ID & 63), std::memory_order_release);
+		signal();
+	}
+
+	/**
+	 * Takes the next topic to send. Consumer thread only
+	 * @return false if nothing is pending
+	 */
+	bool pop(uint8_t &topic_ID)
+	{
+		return _fifo.pop(topic_ID) || take_dirty(topic_ID);
+	}
+
+	/** Consumer thread only */
+	bool empty() const
+	{
+		if (!_fifo.empty()) {
+			return false;
+		}
+
+		for (size_t i = 0; i < DIRTY_WORDS; ++i) {
+			if (0 != _sweep[i] || 0 != _dirty[i].load(std::memory_order_relaxed)) {
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	/**
+	 * Announces that the consumer is about to sleep on get_fd(), so the next push or mark signals it.
+	 * Consumer thread only
+	 * @return false if topics are already pending, in which case the consumer should drain instead of sleeping
+	 */
+	bool arm()
+	{
+		_waiting.store(true, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+
+		if (!empty()) {
+			_waiting.store(false, std::memory_order_relaxed);
+			return false;
+		}
+
+		return true;
+	}
+
+	/**
+	 * Blocks the consumer until a topic is pending or wake() is called
+	 * @param timeout_ms longest wait, -1 for no limit
+	 */
+	void wait(int timeout_ms = -1)
+	{
+		if (arm()) {
+			struct pollfd pfd = {_fd, POLLIN, 0};
+			poll(&pfd, 1, timeout_ms);
+		}
+
+		clear();
+	}
+
+	/** Wakes the consumer, e.g. to have it notice a shutdown request */
+	void wake()
+	{
+		uint64_t one = 1;
+		ssize_t ret = ::write(_fd, &one, sizeof(one));
+		(void)ret;
+	}
+
+	/** Resets the wakeup after the consumer woke up on get_fd() */
+	void clear()
+	{
+		uint64_t count;
+		ssize_t ret = ::read(_fd, &count, sizeof(count));
+		(void)ret;
+	}
+
+	/** eventfd that becomes readable when an armed consumer should wake up */
+	int get_fd() const { return _fd; }
+
+private:
+	static constexpr size_t DIRTY_WORDS = 256 / 64;
+
+	void signal()
+	{
+		// Pairs with the fence in arm(): either the consumer sees the new entry or we see it waiting
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+
+		if (_waiting.load(std::memory_order_relaxed) && _waiting.exchange(false, std::memory_order_acq_rel)) {
+			wake();
+		}
+	}
+
+	bool take_dirty(uint8_t &topic_ID)
+	{
+		for (int pass = 0; pass < 2; ++pass) {
+			for (size_t i = 0; i < DIRTY_WORDS; ++i) {
+				if (0 != _sweep[i]) {
+					topic_ID = (uint8_t)(i * 64 + __builtin_ctzll(_sweep[i]));
+					_sweep[i] &= _sweep[i] - 1;
+					return true;
+				}
+			}
+
+			// Sweep done: start the next one from everything marked meanwhile
+			for (size_t i = 0; i < DIRTY_WORDS; ++i) {
+				_sweep[i] = _dirty[i].exchange(0, std::memory_order_acquire);
+			}
+		}
+
+		return false;
+	}
+
+	/** Sized well beyond the 256 topic IDs, each queued at most once by its subscriber. mark() covers a full FIFO */
+	MPSCQueue<uint8_t, 1024> _fifo;
+	alignas(64) std::atomic<uint64_t> _dirty[DIRTY_WORDS] {};
+	alignas(64) uint64_t _sweep[DIRTY_WORDS] {};
+	std::atomic<bool> _waiting{true};
+	int _fd{-1};
+};
@@ -0,0 +1,248 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2020 PX4 Development Team. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/*!
+ * @file microRTPS_stats.h
+ * @brief Traffic and latency counters of the agent links, updated lock-free on the data paths and formatted for
+ *        dumps as Prometheus text or JSON
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <string>
+
+#include "microRTPS_transport.h"
+
+/**
+ * Latencies counted in power-of-two microsecond buckets: bucket i counts those under 2^i us, the last one all the
+ * others. Recording is a couple of relaxed atomic increments, safe from any number of threads.
+ */
+class LatencyHistogram
+{
+public:
+	static constexpr size_t BUCKETS = 16;
+
+	void record(uint64_t latency_ns)
+	{
+		const uint64_t latency_us = latency_ns / 1000;
+		size_t bucket = 0;
+
+		while (bucket < BUCKETS - 1 && latency_us >= (1ull << bucket)) {
+			++bucket;
+		}
+
+		_counts[bucket].fetch_add(1, std::memory_order_relaxed);
+		_sum_ns.fetch_add(latency_ns, std::memory_order_relaxed);
+	}
+
+	void record(std::chrono::steady_clock::time_point since)
+	{
+		record(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - since).count());
+	}
+
+	uint64_t count(size_t bucket) const { return _counts[bucket].load(std::memory_order_relaxed); }
+
+	/** Exclusive upper bound of a bucket in microseconds, 0 for the last, unbounded one */
+	static uint64_t upper_bound_us(size_t bucket) { return (bucket < BUCKETS - 1) ? (1ull << bucket) : 0; }
+
+	uint64_t sum_ns() const { return _sum_ns.load(std::memory_order_relaxed); }
+
+private:
+	std::atomic<uint64_t> _counts[BUCKETS] {};
+	std::atomic<uint64_t> _sum_ns{0};
+};
+
+/** Counters of a topic on a link. Written by the thread handling the topic in each direction, read by anyone */
+struct TopicStats {
+	// Link -> DDS. Frames of the topic dropped by the frame parser are counted in LinkStats::rx
+	std::atomic<uint64_t> received{0};       ///< Frames decoded
+	std::atomic<uint64_t> received_bytes{0}; ///< Their length, headers included
+	std::atomic<uint64_t> dropped{0};        ///< Frames disabled, decimated or refused by a full publish queue
+	LatencyHistogram decode_to_write;        ///< From the frame decoded to the DDS write done
+
+	// DDS -> link
+	std::atomic<uint64_t> sent{0};           ///< Samples written to the link
+	std::atomic<uint64_t> sent_bytes{0};     ///< Their length, headers excluded
+	std::atomic<uint64_t> send_dropped{0};   ///< Samples decimated or dropped on a full queue
+	LatencyHistogram receive_to_send;        ///< From the DDS sample received to the link write done
+};
+
+/** Counters of a link and of its topics, indexed by topic ID */
+struct LinkStats {
+	RxDropCounters rx; ///< Set as the drop counters of the link transport
+	TopicStats topics[256];
+
+	/** true if anything happened on a topic, the others are left out of the dumps */
+	bool active(uint8_t topic_ID) const
+	{
+		const TopicStats &topic = topics[topic_ID];
+		return topic.received.load(std::memory_order_relaxed) || topic.dropped.load(std::memory_order_relaxed) ||
+		       topic.sent.load(std::memory_order_relaxed) || topic.send_dropped.load(std::memory_order_relaxed);
+	}
+};
+
+/** Name of a bridged topic by ID, nullptr if it is not bridged */
+using TopicNames = std::function<const char *(uint8_t topic_ID)>;
+
+/**
+ * Writes the counters of a link as Prometheus text exposition, labelled with the link index and namespace
+ * @param header true for the first link written to the file, to write the metric types once
+ */
+inline void write_prometheus(FILE *file, const LinkStats &stats, size_t link, const char *ns,
+			     const TopicNames &topic_name, bool header)
+{
+	const char *const link_counters[] = {"garbage_bytes", "crc_errors", "oversize", "seq_gaps"};
+	const uint32_t *const link_values[] = {&stats.rx.garbage_bytes, &stats.rx.crc_errors, &stats.rx.oversize,
+					       &stats.rx.seq_gaps
+					      };
+
+	for (size_t i = 0; i < 4; ++i) {
+		if (header) {
+			fprintf(file, "# TYPE micrortps_link_%s_total counter\n", link_counters[i]);
+		}
+
+		fprintf(file, "micrortps_link_%s_total{link=\"%zu\",namespace=\"%s\"} %lu\n", link_counters[i], link, ns,
+			(unsigned long)RxDropCounters::load(*link_values[i]));
+	}
+
+	std::string names[256];
+
+	for (size_t id = 0; id < 256; ++id) {
+		if (stats.active(id)) {
+			names[id] = topic_name(id) ? topic_name(id) : std::to_string(id);
+		}
+	}
+
+	auto write_counter = [&](const char *name, const std::function<uint64_t(uint8_t)> &value) {
+		if (header) {
+			fprintf(file, "# TYPE micrortps_topic_%s_total counter\n", name);
+		}
+
+		for (size_t id = 0; id < 256; ++id) {
+			if (!names[id].empty()) {
+				fprintf(file, "micrortps_topic_%s_total{link=\"%zu\",namespace=\"%s\",topic=\"%s\"} %lu\n", name, link,
+					ns, names[id].c_str(), (unsigned long)value(id));
+			}
+		}
+	};
+	auto load = [](const std::atomic<uint64_t> &value) { return value.load(std::memory_order_relaxed); };
+
+	write_counter("received", [&](uint8_t id) { return load(stats.topics[id].received); });
+	write_counter("received_bytes", [&](uint8_t id) { return load(stats.topics[id].received_bytes); });
+	write_counter("dropped", [&](uint8_t id) { return load(stats.topics[id].dropped); });
+	write_counter("sent", [&](uint8_t id) { return load(stats.topics[id].sent); });
+	write_counter("sent_bytes", [&](uint8_t id) { return load(stats.topics[id].sent_bytes); });
+	write_counter("send_dropped", [&](uint8_t id) { return load(stats.topics[id].send_dropped); });
+
+	auto write_histogram = [&](const char *name, LatencyHistogram TopicStats::*histogram) {
+		if (header) {
+			fprintf(file, "# TYPE micrortps_topic_%s_latency_us histogram\n", name);
+		}
+
+		for (size_t id = 0; id < 256; ++id) {
+			const LatencyHistogram &latency = stats.topics[id].*histogram;
+			uint64_t cumulative = 0;
+
+			if (names[id].empty()) {
+				continue;
+			}
+
+			for (size_t bucket = 0; bucket < LatencyHistogram::BUCKETS; ++bucket) {
+				const uint64_t bound = LatencyHistogram::upper_bound_us(bucket);
+				cumulative += latency.count(bucket);
+				fprintf(file, "micrortps_topic_%s_latency_us_bucket{link=\"%zu\",namespace=\"%s\",topic=\"%s\",le=\"%s\"} "
+					"%lu\n", name, link, ns, names[id].c_str(), bound ? std::to_string(bound).c_str() : "+Inf",
+					(unsigned long)cumulative);
+			}
+
+			fprintf(file, "micrortps_topic_%s_latency_us_sum{link=\"%zu\",namespace=\"%s\",topic=\"%s\"} %.3f\n",
+				name, link, ns, names[id].c_str(), latency.sum_ns() / 1000.0);
+			fprintf(file, "micrortps_topic_%s_latency_us_count{link=\"%zu\",namespace=\"%s\",topic=\"%s\"} %lu\n",
+				name, link, ns, names[id].c_str(), (unsigned long)cumulative);
+		}
+	};
+
+	write_histogram("decode_to_write", &TopicStats::decode_to_write);
+	write_histogram("receive_to_send", &TopicStats::receive_to_send);
+}
+
+/**
+ * Writes the counters of a link as a JSON object. Bucket i of a histogram counts latencies under 2^i us, the last
+ * one all the others
+ */
+inline void write_json(FILE *file, const LinkStats &stats, size_t link, const char *ns, const TopicNames &topic_name)
+{
+	auto load = [](const std::atomic<uint64_t> &value) { return (unsigned long)value.load(std::memory_order_relaxed); };
+	auto write_histogram = [file](const char *name, const LatencyHistogram &latency) {
+		fprintf(file, "\"%s_us\": {\"buckets\": [", name);
+
+		for (size_t bucket = 0; bucket < LatencyHistogram::BUCKETS; ++bucket) {
+			fprintf(file, "%s%lu", bucket ? ", " : "", (unsigned long)latency.count(bucket));
+		}
+
+		fprintf(file, "], \"sum\": %.3f}", latency.sum_ns() / 1000.0);
+	};
+
+	fprintf(file, "{\"link\": %zu, \"namespace\": \"%s\", \"garbage_bytes\": %lu, \"crc_errors\": %lu, "
+		"\"oversize\": %lu, \"seq_gaps\": %lu, \"topics\": {", link, ns,
+		(unsigned long)RxDropCounters::load(stats.rx.garbage_bytes),
+		(unsigned long)RxDropCounters::load(stats.rx.crc_errors),
+		(unsigned long)RxDropCounters::load(stats.rx.oversize), (unsigned long)RxDropCounters::load(stats.rx.seq_gaps));
+
+	bool first = true;
+
+	for (size_t id = 0; id < 256; ++id) {
+		const TopicStats &topic = stats.topics[id];
+
+		if (!stats.active(id)) {
+			continue;
+		}
+
+		const char *name = topic_name(id);
+		fprintf(file, "%s\n  \"%s\": {\"id\": %zu, \"received\": %lu, \"received_bytes\": %lu, \"dropped\": %lu, "
+			"\"sent\": %lu, \"sent_bytes\": %lu, \"send_dropped\": %lu, ", first ? "" : ",",
+			name ? name : std::to_string(id).c_str(), id, load(topic.received), load(topic.received_bytes),
+			load(topic.dropped), load(topic.sent), load(topic.sent_bytes), load(topic.send_dropped));
+		write_histogram("decode_to_write", topic.decode_to_write);
+		fprintf(file, ", ");
+		write_histogram("receive_to_send", topic.receive_to_send);
+		fprintf(file, "}");
+		first = false;
+	}
+
+	fprintf(file, "}}");
+}
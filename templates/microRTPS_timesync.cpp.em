@@ -83,13 +83,19 @@ void TimeSync::start(const TimesyncPublisher* pub) {
 
 	_timesync_pub = (*pub);
 
+	if (_external_trigger) {
+		return;
+	}
+
 	auto run = [this]() {
-		while (!_request_stop) {
-			timesync_msg_t msg = newTimesyncMsg();
+		if (_thread_init) {
+			_thread_init();
+		}
 
-			_timesync_pub.publish(&msg);
+		while (!_request_stop) {
+			sendTimesync();
 
-			std::this_thread::sleep_for(std::chrono::milliseconds(100));
+			std::this_thread::sleep_for(std::chrono::milliseconds(TIMESYNC_PERIOD_MS));
 		}
 	};
 	_request_stop = false;
@@ -102,6 +108,12 @@ void TimeSync::stop() {
 	_send_timesync_thread.reset();
 }
 
+void TimeSync::sendTimesync() {
+	timesync_msg_t msg = newTimesyncMsg();
+
+	_timesync_pub.publish(&msg);
+}
+
 void TimeSync::reset() {
 	_num_samples = 0;
 	_request_reset_counter = 0;
@@ -85,6 +85,7 @@ static constexpr int WINDOW_SIZE = 500;
 static constexpr int64_t UNKNOWN = 0;
 static constexpr int64_t TRIGGER_RESET_THRESHOLD_NS = 100ll * 1000ll * 1000ll;
 static constexpr int REQUEST_RESET_COUNTER_THRESHOLD = 5;
+static constexpr int TIMESYNC_PERIOD_MS = 100;
 
 @# Sets the timesync DDS type according to the FastRTPS and ROS2 version
 @[if version.parse(fastrtps_version) <= version.parse('1.7.2')]@
@@ -118,6 +119,24 @@ public:
 	 */
 	void start(const TimesyncPublisher* pub);
 
+	/**
+	 * @@brief Leaves the periodic timesync publishing to the caller instead of a thread of its own. Must be set
+	 * before start()
+	 * @@param[in] external true to call sendTimesync() every TIMESYNC_PERIOD_MS from an external timer
+	 */
+	inline void setExternalTrigger(bool external) { _external_trigger = external; }
+
+	/**
+	 * @@brief Sets a function the timesync publishing thread calls first, e.g. to pin it. Must be set before start()
+	 * @@param[in] init Called from the new thread
+	 */
+	inline void setThreadInit(std::function<void()> init) { _thread_init = init; }
+
+	/**
+	 * @@brief Publishes a new timesync message from the agent
+	 */
+	void sendTimesync();
+
 	/**
 	 * @@brief Resets the filter
 	 */
@@ -208,6 +227,8 @@ private:
 
 	std::unique_ptr<std::thread> _send_timesync_thread;
 	std::atomic<bool> _request_stop{false};
+	bool _external_trigger{false};
+	std::function<void()> _thread_init;
 
 	/**
 	 * @@brief Updates the offset of the time sync filter
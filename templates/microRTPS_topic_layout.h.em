@@ -0,0 +1,107 @@
+@###############################################
+@#
+@# EmPy template for generating microRTPS_topic_layout.h file
+@#
+@###############################################
+@# Start of Template
+@#
+@# Context:
+@#  - spec (List) list of all msg specs
+@#  - search_path (List) list of msg search paths
+@#  - ids (List) list of all RTPS msg ids
+@###############################################
+@{
+import genmsg.msgs
+
+from px_generate_uorb_topic_helper import * # this is in Tools/
+from px_generate_uorb_topic_files import MsgScope # this is in Tools/
+
+send_topics = [(alias[idx] if alias[idx] else s.short_name) for idx, s in enumerate(spec) if scope[idx] == MsgScope.SEND]
+recv_topics = [(alias[idx] if alias[idx] else s.short_name) for idx, s in enumerate(spec) if scope[idx] == MsgScope.RECEIVE]
+
+# (field offsets, serialized size) of each topic, once even if it is both sent and received
+layouts = {}
+for idx, s in enumerate(spec):
+    layouts.setdefault(alias[idx] if alias[idx] else s.short_name, cdr_msg_layout(s, search_path[idx]))
+topics = sorted(layouts.keys(), key=lambda topic: rtps_message_id(ids, topic))
+
+def max_serialized_size(topics):
+    sizes = [layouts[topic][1] for topic in topics]
+    return 0 if not sizes or None in sizes else max(sizes)
+}@
+/****************************************************************************
+ *
+ * Copyright (c) 2020 PX4 Development Team. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/*!
+ * @@file microRTPS_topic_layout.h
+ * @@brief CDR layout of the bridged topics, computed by the generator from the msg definitions.
+ *         Offsets are in bytes from the start of the payload, as the client serializes it.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace topic_layout
+{
+
+@[for topic in topics]@
+struct @(topic) {
+    static constexpr uint8_t id = @(rtps_message_id(ids, topic));
+    static constexpr bool fixed_size = @('true' if layouts[topic][1] is not None else 'false');
+    static constexpr size_t max_serialized_size = @(layouts[topic][1] if layouts[topic][1] is not None else 0); // 0 if unbounded
+    // -1 if the field is missing or not at a fixed offset
+    static constexpr int32_t timestamp_offset = @(layouts[topic][0].get('timestamp', -1));
+    static constexpr int32_t timestamp_sample_offset = @(layouts[topic][0].get('timestamp_sample', -1));
+    static constexpr int32_t sys_id_offset = @(layouts[topic][0].get('sys_id', -1));
+    static constexpr int32_t seq_offset = @(layouts[topic][0].get('seq', -1));
+};
+
+@[end for]@
+/** Largest payload the agent sends over the link (topics received from DDS), 0 if one is unbounded **/
+constexpr size_t MAX_SEND_SERIALIZED_SIZE = @(max_serialized_size(recv_topics));
+
+/** Largest payload the agent receives from the link (topics published to DDS), 0 if one is unbounded **/
+constexpr size_t MAX_RECV_SERIALIZED_SIZE = @(max_serialized_size(send_topics));
+
+/** Serialized size of a topic, 0 if unknown or unbounded **/
+constexpr size_t max_serialized_size(uint8_t topic_ID)
+{
+    return
+@[for topic in topics]@
+        (topic_ID == @(topic)::id) ? @(topic)::max_serialized_size :
+@[end for]@
+        0;
+}
+
+} // namespace topic_layout
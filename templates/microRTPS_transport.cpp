@@ -35,7 +35,16 @@
 #include <stdio.h>
 #include <errno.h>
 #include <sys/socket.h>
+#include <time.h>
 #include <cstdlib>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+#if defined(__aarch64__) && defined(__linux__)
+#include <sys/auxv.h>
+#endif
 #if __has_include("px4_platform_common/log.h") && __has_include("px4_platform_common/time.h")
 #include <px4_platform_common/log.h>
 #include <px4_platform_common/time.h>
@@ -43,8 +52,15 @@
 
 #include "microRTPS_transport.h"
 
+#ifdef MICRORTPS_IO_URING
+#include <cstdint>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif /* MICRORTPS_IO_URING */
+
 /** CRC table for the CRC-16. The poly is 0x8005 (x^16 + x^15 + x^2 + 1) */
-uint16_t const crc16_table[256] = {
+static constexpr uint16_t crc16_table[256] = {
 	0x0000, 0xC0C1, 0xC181, 0x0140, 0xC301, 0x03C0, 0x0280, 0xC241,
 	0xC601, 0x06C0, 0x0780, 0xC741, 0x0500, 0xC5C1, 0xC481, 0x0440,
 	0xCC01, 0x0CC0, 0x0D80, 0xCD41, 0x0F00, 0xCFC1, 0xCE81, 0x0E40,
@@ -79,14 +95,192 @@ uint16_t const crc16_table[256] = {
 	0x8201, 0x42C0, 0x4380, 0x8341, 0x4100, 0x81C1, 0x8081, 0x4040
 };
 
+/*
+ * The sliced and carry-less multiply CRC engines are built for the agent only: the client, built within PX4, keeps
+ * the bytewise table and its small footprint. Their tables are computed at compile time, hence C++14.
+ */
+#if !__has_include("px4_platform_common/log.h") && __cplusplus >= 201402L
+#define MICRORTPS_CRC16_SLICED 1
+#endif
+
+#ifdef MICRORTPS_CRC16_SLICED
+/** Slicing-by-8 tables: slice[k] advances a byte through k further zero bytes */
+struct Crc16SliceTables {
+	uint16_t slice[8][256];
+};
+
+static constexpr Crc16SliceTables make_crc16_slice_tables()
+{
+	Crc16SliceTables tables{};
+
+	for (unsigned i = 0; i < 256; ++i) {
+		tables.slice[0][i] = crc16_table[i];
+	}
+
+	for (unsigned k = 1; k < 8; ++k) {
+		for (unsigned i = 0; i < 256; ++i) {
+			uint16_t prev = tables.slice[k - 1][i];
+			tables.slice[k][i] = (prev >> 8) ^ crc16_table[prev & 0xff];
+		}
+	}
+
+	return tables;
+}
+
+static constexpr Crc16SliceTables crc16_slice_tables = make_crc16_slice_tables();
+
+/**
+ * x^n mod 0x18005, bit-reflected into the top of a 64-bit word so that a carry-less multiply by a reflected
+ * data qword yields the product aligned one bit short of the 128-bit lane (hence the n - 1 in the constants)
+ */
+static constexpr uint64_t crc16_fold_constant(unsigned n)
+{
+	uint32_t rem = 1;
+
+	while (n--) {
+		rem <<= 1;
+
+		if (rem & 0x10000) {
+			rem ^= 0x18005;
+		}
+	}
+
+	uint64_t k = 0;
+
+	for (unsigned d = 0; d < 16; ++d) {
+		if (rem & (1u << d)) {
+			k |= 1ull << (63 - d);
+		}
+	}
+
+	return k;
+}
+
+/** Folding constants for the carry-less multiply CRC, bit-reflected x^191 and x^127 mod 0x18005 */
+static constexpr uint64_t crc16_fold_k1 = crc16_fold_constant(192 - 1);
+static constexpr uint64_t crc16_fold_k2 = crc16_fold_constant(128 - 1);
+
+static uint16_t crc16_slice8(const uint8_t *buffer, size_t len, uint16_t crc)
+{
+	const auto &t = crc16_slice_tables.slice;
+
+	while (len >= 8) {
+		crc = t[7][(buffer[0] ^ crc) & 0xff] ^ t[6][buffer[1] ^ (crc >> 8)] ^ t[5][buffer[2]] ^ t[4][buffer[3]] ^
+		      t[3][buffer[4]] ^ t[2][buffer[5]] ^ t[1][buffer[6]] ^ t[0][buffer[7]];
+		buffer += 8;
+		len -= 8;
+	}
+
+	while (len--) {
+		crc = (crc >> 8) ^ crc16_table[(crc ^ *buffer++) & 0xff];
+	}
+
+	return crc;
+}
+
+/*
+ * The carry-less multiply versions fold the buffer 16 bytes at a time: with X = H x^64 + L the pending block,
+ * X x^128 = H x^192 + L x^128 is congruent to H (x^192 mod P) + L (x^128 mod P), which is at most 80 bits wide and
+ * is XORed into the next block. The last folded block and the tail go through the table, which does the reduction.
+ */
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("pclmul,sse2")))
+static uint16_t crc16_clmul(const uint8_t *buffer, size_t len, uint16_t crc)
+{
+	if (len < 32) {
+		return crc16_slice8(buffer, len, crc);
+	}
+
+	const __m128i k = _mm_set_epi64x((long long)crc16_fold_k2, (long long)crc16_fold_k1);
+	__m128i x = _mm_xor_si128(_mm_loadu_si128((const __m128i *)buffer), _mm_cvtsi32_si128(crc));
+	buffer += 16;
+	len -= 16;
+
+	while (len >= 16) {
+		x = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x, k, 0x00), _mm_clmulepi64_si128(x, k, 0x11)),
+				  _mm_loadu_si128((const __m128i *)buffer));
+		buffer += 16;
+		len -= 16;
+	}
+
+	uint8_t folded[16];
+	_mm_storeu_si128((__m128i *)folded, x);
+
+	return crc16_slice8(buffer, len, crc16_slice8(folded, sizeof(folded), 0));
+}
+#elif defined(__aarch64__) && defined(__linux__) && defined(HWCAP_PMULL)
+__attribute__((target("+crypto")))
+static uint16_t crc16_clmul(const uint8_t *buffer, size_t len, uint16_t crc)
+{
+	if (len < 32) {
+		return crc16_slice8(buffer, len, crc);
+	}
+
+	uint64x2_t x = veorq_u64(vreinterpretq_u64_u8(vld1q_u8(buffer)), vcombine_u64(vcreate_u64(crc), vcreate_u64(0)));
+	buffer += 16;
+	len -= 16;
+
+	while (len >= 16) {
+		poly128_t lo = vmull_p64((poly64_t)vgetq_lane_u64(x, 0), (poly64_t)crc16_fold_k1);
+		poly128_t hi = vmull_p64((poly64_t)vgetq_lane_u64(x, 1), (poly64_t)crc16_fold_k2);
+		x = veorq_u64(veorq_u64(vreinterpretq_u64_p128(lo), vreinterpretq_u64_p128(hi)),
+			      vreinterpretq_u64_u8(vld1q_u8(buffer)));
+		buffer += 16;
+		len -= 16;
+	}
+
+	uint8_t folded[16];
+	vst1q_u8(folded, vreinterpretq_u8_u64(x));
+
+	return crc16_slice8(buffer, len, crc16_slice8(folded, sizeof(folded), 0));
+}
+#endif
+
+typedef uint16_t (*crc16_fn)(const uint8_t *, size_t, uint16_t);
+
+static uint16_t crc16_resolve(const uint8_t *buffer, size_t len, uint16_t crc);
+
+/**
+ * CRC-16 engine for the running CPU, bit-identical to a crc16_table lookup per byte. Constant initialized to the
+ * resolver, which picks the engine on the first CRC computed, so that it works from static constructors too
+ */
+static crc16_fn crc16_engine = crc16_resolve;
+
+static uint16_t crc16_resolve(const uint8_t *buffer, size_t len, uint16_t crc)
+{
+	crc16_fn engine = crc16_slice8;
+
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_cpu_init();
+
+	if (__builtin_cpu_supports("pclmul")) {
+		engine = crc16_clmul;
+	}
+
+#elif defined(__aarch64__) && defined(__linux__) && defined(HWCAP_PMULL)
+
+	if (getauxval(AT_HWCAP) & HWCAP_PMULL) {
+		engine = crc16_clmul;
+	}
+
+#endif
+	// Threads racing here all pick and store the same engine
+	__atomic_store_n(&crc16_engine, engine, __ATOMIC_RELAXED);
+	return engine(buffer, len, crc);
+}
+#endif /* MICRORTPS_CRC16_SLICED */
+
 Transport_node::Transport_node(const bool _debug):
-    rx_buff_pos(0),
-    debug(_debug)
+	rx_head(0),
+	rx_tail(0),
+	debug(_debug)
 {
+	pthread_mutex_init(&tx_mutex, nullptr);
 }
 
 Transport_node::~Transport_node()
 {
+	pthread_mutex_destroy(&tx_mutex);
 }
 
 uint16_t Transport_node::crc16_byte(uint16_t crc, const uint8_t data)
@@ -94,15 +288,145 @@ uint16_t Transport_node::crc16_byte(uint16_t crc, const uint8_t data)
 	return (crc >> 8) ^ crc16_table[(crc ^ data) & 0xff];
 }
 
-uint16_t Transport_node::crc16(uint8_t const *buffer, size_t len)
+uint16_t Transport_node::crc16(uint8_t const *buffer, size_t len, uint16_t crc)
 {
-	uint16_t crc = 0;
+#ifdef MICRORTPS_CRC16_SLICED
+	return __atomic_load_n(&crc16_engine, __ATOMIC_RELAXED)(buffer, len, crc);
+#else
 
 	while (len--) {
 		crc = crc16_byte(crc, *buffer++);
 	}
 
 	return crc;
+#endif /* MICRORTPS_CRC16_SLICED */
+}
+
+/**
+ * Frame marker scanners. Each returns the first position i < len - 2 where buf[i..i+2] is ">>>", or len if there
+ * is none. The vector versions compare three overlapping loads against '>' so a hit needs all three lanes set.
+ */
+static size_t find_marker_scalar(const char *buf, size_t len)
+{
+	for (size_t i = 0; i + 2 < len; ++i) {
+		if ('>' == buf[i] && '>' == buf[i + 1] && '>' == buf[i + 2]) {
+			return i;
+		}
+	}
+
+	return len;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("sse2")))
+static size_t find_marker_sse2(const char *buf, size_t len)
+{
+	const __m128i marker = _mm_set1_epi8('>');
+	size_t i = 0;
+
+	for (; i + 2 + 16 <= len; i += 16) {
+		__m128i m = _mm_and_si128(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(buf + i)), marker),
+					  _mm_and_si128(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(buf + i + 1)), marker),
+							_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(buf + i + 2)), marker)));
+		int mask = _mm_movemask_epi8(m);
+
+		if (mask) {
+			return i + __builtin_ctz(mask);
+		}
+	}
+
+	size_t tail = find_marker_scalar(buf + i, len - i);
+	return (tail == len - i) ? len : i + tail;
+}
+
+__attribute__((target("avx2")))
+static size_t find_marker_avx2(const char *buf, size_t len)
+{
+	const __m256i marker = _mm256_set1_epi8('>');
+	size_t i = 0;
+
+	for (; i + 2 + 32 <= len; i += 32) {
+		__m256i m = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(buf + i)), marker),
+					     _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(buf + i + 1)), marker),
+							      _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(buf + i + 2)), marker)));
+		unsigned mask = (unsigned)_mm256_movemask_epi8(m);
+
+		if (mask) {
+			return i + __builtin_ctz(mask);
+		}
+	}
+
+	// Stay out of the SSE2 version for the tail to avoid AVX/SSE transition stalls
+	size_t tail = find_marker_scalar(buf + i, len - i);
+	return (tail == len - i) ? len : i + tail;
+}
+#elif defined(__ARM_NEON)
+static size_t find_marker_neon(const char *buf, size_t len)
+{
+	const uint8x16_t marker = vdupq_n_u8('>');
+	const uint8_t *p = (const uint8_t *)buf;
+	size_t i = 0;
+
+	for (; i + 2 + 16 <= len; i += 16) {
+		uint8x16_t m = vandq_u8(vceqq_u8(vld1q_u8(p + i), marker),
+					vandq_u8(vceqq_u8(vld1q_u8(p + i + 1), marker), vceqq_u8(vld1q_u8(p + i + 2), marker)));
+		// Narrow to 4 bits per lane to get a scalar mask there is no movemask for
+		uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(m), 4)), 0);
+
+		if (mask) {
+			return i + (__builtin_ctzll(mask) >> 2);
+		}
+	}
+
+	size_t tail = find_marker_scalar(buf + i, len - i);
+	return (tail == len - i) ? len : i + tail;
+}
+#endif
+
+typedef size_t (*find_marker_fn)(const char *, size_t);
+
+static size_t find_marker_resolve(const char *buf, size_t len);
+
+/**
+ * Marker scanner for the running CPU. Constant initialized to the resolver, which picks the scanner on the first
+ * scan, so that it works from static constructors too
+ */
+static find_marker_fn find_marker_engine = find_marker_resolve;
+
+static size_t find_marker_resolve(const char *buf, size_t len)
+{
+	find_marker_fn scanner = find_marker_scalar;
+
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_cpu_init();
+
+	if (__builtin_cpu_supports("avx2")) {
+		scanner = find_marker_avx2;
+
+	} else if (__builtin_cpu_supports("sse2")) {
+		scanner = find_marker_sse2;
+	}
+
+#elif defined(__ARM_NEON)
+	scanner = find_marker_neon;
+#endif
+	// Threads racing here all pick and store the same scanner
+	__atomic_store_n(&find_marker_engine, scanner, __ATOMIC_RELAXED);
+	return scanner(buf, len);
+}
+
+uint32_t Transport_node::rx_find_marker(uint32_t limit) const
+{
+	const char *buf = rx_buffer + rx_head;
+
+	// Back to back frames start right at rx_head
+	if ('>' == buf[0] && '>' == buf[1] && '>' == buf[2]) {
+		return 0;
+	}
+
+	// The scanners need the two bytes after the last candidate, which the caller leaves buffered
+	size_t hit = __atomic_load_n(&find_marker_engine, __ATOMIC_RELAXED)(buf, limit + 2);
+	return (hit < limit) ? hit : limit;
 }
 
 ssize_t Transport_node::read(uint8_t *topic_ID, char out_buffer[], size_t buffer_len)
@@ -111,44 +435,117 @@ ssize_t Transport_node::read(uint8_t *topic_ID, char out_buffer[], size_t buffer
 		return -1;
 	}
 
+	// Hand out frames that are already buffered before reading from the link again
+	ssize_t len = 0;
+
+	if (rx_parsable() && 0 != (len = parse_frame(topic_ID, out_buffer, buffer_len))) {
+		return len;
+	}
+
+	if (0 > (len = rx_fill())) {
+		return len;
+	}
+
 	*topic_ID = 255;
+	return rx_parsable() ? parse_frame(topic_ID, out_buffer, buffer_len) : 0;
+}
+
+ssize_t Transport_node::rx_fill()
+{
+	rx_compact();
 
-	ssize_t len = node_read((void *)(rx_buffer + rx_buff_pos), sizeof(rx_buffer) - rx_buff_pos);
+	struct iovec iov = {rx_buffer + rx_tail, BUFFER_SIZE - rx_tail};
+	ssize_t len = 0;
+
+	if (iov.iov_len > 0) {
+		len = node_read(&iov, 1);
+	}
 
 	if (len < 0) {
-		int errsv = errno;
+		rx_read_failed();
+		return len;
+	}
+
+	rx_tail += len;
+	return len;
+}
+
+ssize_t Transport_node::read_raw(char buffer[], size_t len)
+{
+	if (nullptr == buffer || !fds_OK()) {
+		return -1;
+	}
+
+	struct iovec iov = {buffer, len};
+	ssize_t ret = node_read(&iov, 1);
+
+	if (ret < 0) {
+		rx_read_failed();
+	}
+
+	return ret;
+}
+
+void Transport_node::rx_read_failed() const
+{
+	int errsv = errno;
 
-		if (errsv && EAGAIN != errsv && ETIMEDOUT != errsv) {
+	if (errsv && EAGAIN != errsv && ETIMEDOUT != errsv) {
 #ifndef PX4_DEBUG
-			if (debug) printf("\033[0;31m[ micrortps_transport ]\tRead fail %d\033[0m\n", errsv);
+		if (debug) printf("\033[0;31m[ micrortps_transport ]\tRead fail %d\033[0m\n", errsv);
 #else
-			if (debug) PX4_DEBUG("Read fail %d", errsv);
+		if (debug) PX4_DEBUG("Read fail %d", errsv);
 #endif /* PX4_DEBUG */
-		}
+	}
+}
 
-		return len;
+size_t Transport_node::rx_push(const char *data, size_t len)
+{
+	rx_compact();
+
+	if (len > BUFFER_SIZE - rx_tail) {
+		len = BUFFER_SIZE - rx_tail;
+	}
+
+	memcpy(rx_buffer + rx_tail, data, len);
+	rx_tail += len;
+	return len;
+}
+
+void Transport_node::rx_compact()
+{
+	uint32_t rx_count = rx_buff_count();
+
+	if (0 == rx_count) {
+		rx_head = rx_tail = 0;
+
+	} else if (BUFFER_SIZE - rx_tail < rx_head) {
+		// Moves at most the frame being received, once per buffer's worth of bytes rather than once per frame
+		memmove(rx_buffer, rx_buffer + rx_head, rx_count);
+		rx_head = 0;
+		rx_tail = rx_count;
 	}
+}
 
-	rx_buff_pos += len;
+ssize_t Transport_node::parse_frame(uint8_t *topic_ID, char out_buffer[], size_t buffer_len)
+{
+	*topic_ID = 255;
 
-	// We read some
+	ssize_t len = 0;
 	size_t header_size = sizeof(struct Header);
+	uint32_t rx_count = rx_buff_count();
 
-	// but not enough
-	if (rx_buff_pos < header_size) {
+	// Not enough buffered for a header, or not yet the rest of the incomplete frame found by the last call
+	if (!rx_parsable()) {
 		return 0;
 	}
 
-	uint32_t msg_start_pos = 0;
+	rx_wanted = header_size;
 
-	for (msg_start_pos = 0; msg_start_pos <= rx_buff_pos - header_size; ++msg_start_pos) {
-		if ('>' == rx_buffer[msg_start_pos] && memcmp(rx_buffer + msg_start_pos, ">>>", 3) == 0) {
-			break;
-		}
-	}
+	uint32_t msg_start_pos = rx_find_marker(rx_count - header_size + 1);
 
 	// Start not found
-	if (msg_start_pos > (rx_buff_pos - header_size)) {
+	if (msg_start_pos > (rx_count - header_size)) {
 #ifndef PX4_DEBUG
 		if (debug) printf("\033[1;33m[ micrortps_transport ]\t                                (↓↓ %u)\033[0m\n", msg_start_pos);
 #else
@@ -156,25 +553,35 @@ ssize_t Transport_node::read(uint8_t *topic_ID, char out_buffer[], size_t buffer
 #endif /* PX4_DEBUG */
 
 		// All we've checked so far is garbage, drop it - but save unchecked bytes
-		memmove(rx_buffer, rx_buffer + msg_start_pos, rx_buff_pos - msg_start_pos);
-		rx_buff_pos -= msg_start_pos;
+		rx_head += msg_start_pos;
+
+		if (rx_drops) {
+			RxDropCounters::add(rx_drops->garbage_bytes, msg_start_pos);
+		}
+
 		return -1;
 	}
 
 	// [>,>,>,topic_ID,seq,payload_length_H,payload_length_L,CRCHigh,CRCLow,payloadStart, ... ,payloadEnd]
-	struct Header *header = (struct Header *)&rx_buffer[msg_start_pos];
+	const char *msg = rx_buffer + rx_head + msg_start_pos;
+	const struct Header *header = (const struct Header *)msg;
 	uint32_t payload_len = ((uint32_t)header->payload_len_h << 8) | header->payload_len_l;
 
 	// The message won't fit the buffer.
-	if (buffer_len < header_size + payload_len) {
+	if (buffer_len < header_size + payload_len || sizeof(rx_buffer) < header_size + payload_len) {
 		// Drop the message and continue with the read buffer
-		memmove(rx_buffer, rx_buffer + msg_start_pos + 1, rx_buff_pos - (msg_start_pos + 1));
-		rx_buff_pos -= (msg_start_pos + 1);
+		rx_head += msg_start_pos + 1;
+
+		if (rx_drops) {
+			RxDropCounters::add(rx_drops->garbage_bytes, msg_start_pos);
+			RxDropCounters::add(rx_drops->oversize, 1);
+		}
+
 		return -EMSGSIZE;
 	}
 
 	// We do not have a complete message yet
-	if (msg_start_pos + header_size + payload_len > rx_buff_pos) {
+	if (msg_start_pos + header_size + payload_len > rx_count) {
 		// If there's garbage at the beginning, drop it
 		if (msg_start_pos > 0) {
 #ifndef PX4_DEBUG
@@ -182,15 +589,19 @@ ssize_t Transport_node::read(uint8_t *topic_ID, char out_buffer[], size_t buffer
 #else
 			if (debug) PX4_DEBUG("                             (↓ %u)", msg_start_pos);
 #endif /* PX4_DEBUG */
-			memmove(rx_buffer, rx_buffer + msg_start_pos, rx_buff_pos - msg_start_pos);
-			rx_buff_pos -= msg_start_pos;
+			rx_head += msg_start_pos;
+
+			if (rx_drops) {
+				RxDropCounters::add(rx_drops->garbage_bytes, msg_start_pos);
+			}
 		}
 
+		rx_wanted = header_size + payload_len;
 		return 0;
 	}
 
 	uint16_t read_crc = ((uint16_t)header->crc_h << 8) | header->crc_l;
-	uint16_t calc_crc = crc16((uint8_t *)rx_buffer + msg_start_pos + header_size, payload_len);
+	uint16_t calc_crc = crc16((const uint8_t *)msg + header_size, payload_len);
 
 	if (read_crc != calc_crc) {
 #ifndef PX4_DEBUG
@@ -199,23 +610,36 @@ ssize_t Transport_node::read(uint8_t *topic_ID, char out_buffer[], size_t buffer
 		if (debug) PX4_DEBUG("Bad CRC %u != %u\t\t(↓ %lu)", read_crc, calc_crc, (unsigned long)(header_size + payload_len));
 #endif /* PX4_DEBUG */
 
-		// Drop garbage up just beyond the start of the message
-		memmove(rx_buffer, rx_buffer + (msg_start_pos + 1), rx_buff_pos);
-
+		// Drop garbage up just beyond the start of the message.
 		// If there is a CRC error, the payload len cannot be trusted
-		rx_buff_pos -= (msg_start_pos + 1);
+		rx_head += msg_start_pos + 1;
+
+		if (rx_drops) {
+			RxDropCounters::add(rx_drops->garbage_bytes, msg_start_pos);
+			RxDropCounters::add(rx_drops->crc_errors, 1);
+		}
 
 		len = -1;
 
 	} else {
 		// copy message to outbuffer and set other return values
-		memmove(out_buffer, rx_buffer + msg_start_pos + header_size, payload_len);
+		memcpy(out_buffer, msg + header_size, payload_len);
 		*topic_ID = header->topic_ID;
 		len = payload_len + header_size;
 
 		// discard message from rx_buffer
-		rx_buff_pos -= msg_start_pos + header_size + payload_len;
-		memmove(rx_buffer, rx_buffer + msg_start_pos + header_size + payload_len, rx_buff_pos);
+		rx_head += msg_start_pos + header_size + payload_len;
+
+		if (rx_drops) {
+			RxDropCounters::add(rx_drops->garbage_bytes, msg_start_pos);
+
+			// The sender numbers all its frames in one 8-bit sequence, so up to 255 missing ones can be told apart
+			if (rx_seq_expected >= 0) {
+				RxDropCounters::add(rx_drops->seq_gaps, (uint8_t)(header->seq - rx_seq_expected));
+			}
+
+			rx_seq_expected = (uint8_t)(header->seq + 1);
+		}
 	}
 
 	return len;
@@ -228,32 +652,51 @@ size_t Transport_node::get_header_length()
 
 ssize_t Transport_node::write(const uint8_t topic_ID, char buffer[], size_t length)
 {
-	if (!fds_OK()) {
+	if (nullptr == buffer) {
 		return -1;
 	}
 
-	static struct Header header = {{'>', '>', '>'}, 0u, 0u, 0u, 0u, 0u, 0u};
+	/* Headroom for header is created in client, but the header is now sent from its own buffer */
+	return write_payload(topic_ID, &buffer[sizeof(struct Header)], length);
+}
 
-	// [>,>,>,topic_ID,seq,payload_length,CRCHigh,CRCLow,payload_start, ... ,payload_end]
-	uint16_t crc = crc16((uint8_t *)&buffer[sizeof(header)], length);
+ssize_t Transport_node::write_payload(const uint8_t topic_ID, const char payload[], size_t length)
+{
+	if (nullptr == payload || !fds_OK()) {
+		return -1;
+	}
 
-	header.topic_ID = topic_ID;
+	// [>,>,>,topic_ID,seq,payload_length,CRCHigh,CRCLow,payload_start, ... ,payload_end]
+	uint16_t crc = crc16((const uint8_t *)payload, length);
+	struct Header header = {{'>', '>', '>'}, topic_ID, 0u, (uint8_t)((length >> 8) & 0xff), (uint8_t)(length & 0xff),
+		       (uint8_t)((crc >> 8) & 0xff), (uint8_t)(crc & 0xff)
+	};
+
+	struct iovec iov[2];
+	iov[0].iov_base = &header;
+	iov[0].iov_len = sizeof(header);
+	iov[1].iov_base = const_cast<char *>(payload);
+	iov[1].iov_len = length;
+
+	pthread_mutex_lock(&tx_mutex);
 	header.seq = _seq_number++;
-	header.payload_len_h = (length >> 8) & 0xff;
-	header.payload_len_l = length & 0xff;
-	header.crc_h = (crc >> 8) & 0xff;
-	header.crc_l = crc & 0xff;
-
-	/* Headroom for header is created in client */
-	/* Fill in the header in the same payload buffer to call a single node_write */
-	memcpy(buffer, &header, sizeof(header));
-	ssize_t len = node_write(buffer, length + sizeof(header));
+	ssize_t len = node_write(iov, 2);
+	pthread_mutex_unlock(&tx_mutex);
+
 	if (len != ssize_t(length + sizeof(header))) {
 		return len;
 	}
 	return len + sizeof(header);
 }
 
+ssize_t Transport_node::flush()
+{
+	pthread_mutex_lock(&tx_mutex);
+	ssize_t ret = node_flush();
+	pthread_mutex_unlock(&tx_mutex);
+	return ret;
+}
+
 UART_node::UART_node(const char *_uart_name, const uint32_t _baudrate,
 					 const uint32_t _poll_ms, const bool _hw_flow_control,
 					 const bool _sw_flow_control, const bool _debug):
@@ -425,29 +868,29 @@ uint8_t UART_node::close()
 	return 0;
 }
 
-ssize_t UART_node::node_read(void *buffer, size_t len)
+ssize_t UART_node::node_read(const struct iovec *iov, int iovcnt)
 {
-	if (nullptr == buffer || !fds_OK()) {
+	if (nullptr == iov || !fds_OK()) {
 		return -1;
 	}
 
 	ssize_t ret = 0;
-	int r = poll(poll_fd, 1, poll_ms);
+	int r = poll(poll_fd, 1, rx_nonblocking ? 0 : poll_ms);
 
 	if (r == 1 && (poll_fd[0].revents & POLLIN)) {
-		ret = ::read(uart_fd, buffer, len);
+		ret = ::readv(uart_fd, iov, iovcnt);
 	}
 
 	return ret;
 }
 
-ssize_t UART_node::node_write(void *buffer, size_t len)
+ssize_t UART_node::node_write(const struct iovec *iov, int iovcnt)
 {
-	if (nullptr == buffer || !fds_OK()) {
+	if (nullptr == iov || !fds_OK()) {
 		return -1;
 	}
 
-	return ::write(uart_fd, buffer, len);
+	return ::writev(uart_fd, iov, iovcnt);
 }
 
 bool UART_node::baudrate_to_speed(uint32_t bauds, speed_t *speed)
@@ -549,13 +992,25 @@ bool UART_node::baudrate_to_speed(uint32_t bauds, speed_t *speed)
 	return true;
 }
 
+#if defined(__linux__)
+static uint64_t monotonic_us()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+#endif /* __linux__ */
+
 UDP_node::UDP_node(const char* _udp_ip, uint16_t _udp_port_recv,
-				   uint16_t _udp_port_send, const bool _debug):
+				   uint16_t _udp_port_send, const bool _debug, uint32_t _batch_size,
+				   uint32_t _batch_timeout_us):
 	Transport_node(_debug),
 	sender_fd(-1),
 	receiver_fd(-1),
 	udp_port_recv(_udp_port_recv),
-	udp_port_send(_udp_port_send)
+	udp_port_send(_udp_port_send),
+	batch_size(_batch_size),
+	batch_timeout_us(_batch_timeout_us)
 {
     if (nullptr != _udp_ip) {
             strcpy(udp_ip, _udp_ip);
@@ -565,6 +1020,14 @@ UDP_node::UDP_node(const char* _udp_ip, uint16_t _udp_port_recv,
 UDP_node::~UDP_node()
 {
 	close();
+
+	// Released here rather than in close(), which may run from a signal handler while a read is in progress
+	delete[] rx_slots;
+	delete[] rx_slot_iovs;
+	delete[] rx_msgs;
+	delete[] tx_slots;
+	delete[] tx_slot_iovs;
+	delete[] tx_msgs;
 }
 
 int UDP_node::init()
@@ -573,6 +1036,37 @@ int UDP_node::init()
 		return -1;
 	}
 
+#if defined(__linux__)
+
+	if (batch_size > 1 && nullptr == rx_msgs) {
+		rx_slots = new char[batch_size * BUFFER_SIZE];
+		rx_slot_iovs = new struct iovec[batch_size];
+		rx_msgs = new struct mmsghdr[batch_size]();
+		tx_slots = new char[batch_size * BUFFER_SIZE];
+		tx_slot_iovs = new struct iovec[batch_size];
+		tx_msgs = new struct mmsghdr[batch_size]();
+
+		for (uint32_t i = 0; i < batch_size; ++i) {
+			rx_slot_iovs[i].iov_base = rx_slots + i * BUFFER_SIZE;
+			rx_slot_iovs[i].iov_len = BUFFER_SIZE;
+			rx_msgs[i].msg_hdr.msg_name = &receiver_outaddr;
+			rx_msgs[i].msg_hdr.msg_iov = &rx_slot_iovs[i];
+			rx_msgs[i].msg_hdr.msg_iovlen = 1;
+
+			tx_slot_iovs[i].iov_base = tx_slots + i * BUFFER_SIZE;
+			tx_slot_iovs[i].iov_len = 0;
+			tx_msgs[i].msg_hdr.msg_name = &sender_outaddr;
+			tx_msgs[i].msg_hdr.msg_namelen = sizeof(sender_outaddr);
+			tx_msgs[i].msg_hdr.msg_iov = &tx_slot_iovs[i];
+			tx_msgs[i].msg_hdr.msg_iovlen = 1;
+		}
+	}
+
+#else
+	// recvmmsg/sendmmsg are Linux only
+	batch_size = 1;
+#endif /* __linux__ */
+
 	return 0;
 }
 
@@ -682,30 +1176,749 @@ uint8_t UDP_node::close()
 	return 0;
 }
 
-ssize_t UDP_node::node_read(void *buffer, size_t len)
+ssize_t UDP_node::node_read(const struct iovec *iov, int iovcnt)
 {
-	if (nullptr == buffer || !fds_OK()) {
+	if (nullptr == iov || !fds_OK()) {
 		return -1;
 	}
 
 	int ret = 0;
+#if defined(__linux__)
+
+	if (nullptr != rx_msgs) {
+		if (rx_msg_pos >= rx_msg_count) {
+			// Waits for the first datagram only, then takes whatever else is already queued on the socket
+			for (uint32_t i = 0; i < batch_size; ++i) {
+				rx_msgs[i].msg_hdr.msg_namelen = sizeof(receiver_outaddr);
+			}
+
+			ret = recvmmsg(receiver_fd, rx_msgs, batch_size, MSG_WAITFORONE | (rx_nonblocking ? MSG_DONTWAIT : 0), nullptr);
+
+			if (ret <= 0) {
+				return ret;
+			}
+
+			rx_msg_count = ret;
+			rx_msg_pos = 0;
+			rx_msg_offset = 0;
+		}
+
+		// Hand staged datagrams to the ring segments. One that does not fit is resumed on the next read
+		ssize_t copied = 0;
+		int seg = 0;
+		size_t seg_offset = 0;
+
+		while (rx_msg_pos < rx_msg_count && seg < iovcnt) {
+			size_t avail = rx_msgs[rx_msg_pos].msg_len - rx_msg_offset;
+			size_t room = iov[seg].iov_len - seg_offset;
+			size_t n = (avail < room) ? avail : room;
+
+			memcpy((char *)iov[seg].iov_base + seg_offset, rx_slots + rx_msg_pos * BUFFER_SIZE + rx_msg_offset, n);
+			copied += n;
+			seg_offset += n;
+			rx_msg_offset += n;
+
+			if (rx_msg_offset == rx_msgs[rx_msg_pos].msg_len) {
+				++rx_msg_pos;
+				rx_msg_offset = 0;
+			}
+
+			if (seg_offset == iov[seg].iov_len) {
+				++seg;
+				seg_offset = 0;
+			}
+		}
+
+		return copied;
+	}
+
+#endif /* __linux__ */
 #if !defined (__PX4_NUTTX) || (defined (CONFIG_NET) && defined (__PX4_NUTTX))
-	// Blocking call
-	static socklen_t addrlen = sizeof(receiver_outaddr);
-	ret = recvfrom(receiver_fd, buffer, len, 0, (struct sockaddr *) &receiver_outaddr, &addrlen);
+	// Blocking call unless rx_nonblocking. The datagram is scattered over the ring segments instead of being truncated at the wrap
+	struct msghdr msg = {};
+	msg.msg_name = &receiver_outaddr;
+	msg.msg_namelen = sizeof(receiver_outaddr);
+	msg.msg_iov = const_cast<struct iovec *>(iov);
+	msg.msg_iovlen = iovcnt;
+	ret = recvmsg(receiver_fd, &msg, rx_nonblocking ? MSG_DONTWAIT : 0);
 #endif /* __PX4_NUTTX */
 	return ret;
 }
 
-ssize_t UDP_node::node_write(void *buffer, size_t len)
+ssize_t UDP_node::node_write(const struct iovec *iov, int iovcnt)
 {
-	if (nullptr == buffer || !fds_OK()) {
+	if (nullptr == iov || !fds_OK()) {
 		return -1;
 	}
 
 	int ret = 0;
+#if defined(__linux__)
+	size_t len = 0;
+
+	for (int i = 0; i < iovcnt; ++i) {
+		len += iov[i].iov_len;
+	}
+
+	if (nullptr != tx_msgs && len <= BUFFER_SIZE) {
+		if (0 == tx_msg_count) {
+			tx_first_us = monotonic_us();
+		}
+
+		// The staged copy is what sendmmsg needs anyway, so the frame is gathered straight into its slot
+		char *slot = (char *)tx_slot_iovs[tx_msg_count].iov_base;
+
+		for (int i = 0; i < iovcnt; ++i) {
+			memcpy(slot, iov[i].iov_base, iov[i].iov_len);
+			slot += iov[i].iov_len;
+		}
+
+		tx_slot_iovs[tx_msg_count].iov_len = len;
+		++tx_msg_count;
+
+		if (tx_msg_count == batch_size || monotonic_us() - tx_first_us >= batch_timeout_us) {
+			if (0 > node_flush()) {
+				return -1;
+			}
+		}
+
+		return len;
+	}
+
+	// Keep datagrams in order when one is too large to stage
+	if (0 > node_flush()) {
+		return -1;
+	}
+
+#endif /* __linux__ */
 #if !defined (__PX4_NUTTX) || (defined (CONFIG_NET) && defined (__PX4_NUTTX))
-	ret = sendto(sender_fd, buffer, len, 0, (struct sockaddr *)&sender_outaddr, sizeof(sender_outaddr));
+	struct msghdr msg = {};
+	msg.msg_name = &sender_outaddr;
+	msg.msg_namelen = sizeof(sender_outaddr);
+	msg.msg_iov = const_cast<struct iovec *>(iov);
+	msg.msg_iovlen = iovcnt;
+	ret = sendmsg(sender_fd, &msg, 0);
 #endif /* __PX4_NUTTX */
 	return ret;
 }
+
+ssize_t UDP_node::node_flush()
+{
+	ssize_t ret = 0;
+#if defined(__linux__)
+	uint32_t sent_msgs = 0;
+
+	while (sent_msgs < tx_msg_count) {
+		int n = sendmmsg(sender_fd, tx_msgs + sent_msgs, tx_msg_count - sent_msgs, 0);
+
+		if (n < 0) {
+			if (EINTR == errno) {
+				continue;
+			}
+
+#ifndef PX4_DEBUG
+			if (debug) printf("\033[0;31m[ micrortps_transport ]\tUDP transport: sendmmsg fail %d, %u datagrams dropped\033[0m\n", errno, tx_msg_count - sent_msgs);
+#else
+			if (debug) PX4_DEBUG("UDP transport: sendmmsg fail %d, %u datagrams dropped", errno, tx_msg_count - sent_msgs);
+#endif /* PX4_DEBUG */
+			ret = -1;
+			break;
+		}
+
+		for (int i = 0; i < n; ++i) {
+			ret += tx_msgs[sent_msgs + i].msg_len;
+		}
+
+		sent_msgs += n;
+	}
+
+	// A failed batch is dropped, as a failed sendto would drop its datagram
+	tx_msg_count = 0;
+#endif /* __linux__ */
+	return ret;
+}
+
+#ifdef MICRORTPS_IO_URING
+
+Uring_ring::~Uring_ring()
+{
+	teardown();
+}
+
+void Uring_ring::teardown()
+{
+	if (nullptr != sqes) {
+		munmap(sqes, sqes_len);
+	}
+
+	if (nullptr != cq_ptr && cq_ptr != sq_ptr) {
+		munmap(cq_ptr, cq_len);
+	}
+
+	if (nullptr != sq_ptr) {
+		munmap(sq_ptr, sq_len);
+	}
+
+	// Closing the ring cancels whatever is still in flight
+	if (-1 != fd) {
+		::close(fd);
+	}
+
+	sqes = nullptr;
+	cq_ptr = sq_ptr = nullptr;
+	fd = -1;
+}
+
+int Uring_ring::setup(unsigned entries)
+{
+	struct io_uring_params p;
+	memset(&p, 0, sizeof(p));
+
+	fd = syscall(__NR_io_uring_setup, entries, &p);
+
+	if (fd < 0) {
+		fd = -1;
+		return -1;
+	}
+
+	sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+
+	bool single_mmap = p.features & IORING_FEAT_SINGLE_MMAP;
+
+	if (single_mmap) {
+		sq_len = cq_len = (sq_len > cq_len) ? sq_len : cq_len;
+	}
+
+	sq_ptr = mmap(nullptr, sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+	cq_ptr = single_mmap ? sq_ptr : mmap(nullptr, cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+					     IORING_OFF_CQ_RING);
+	void *sqes_ptr = mmap(nullptr, sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+
+	if (MAP_FAILED == sq_ptr || MAP_FAILED == cq_ptr || MAP_FAILED == sqes_ptr) {
+		sq_ptr = (MAP_FAILED == sq_ptr) ? nullptr : sq_ptr;
+		cq_ptr = (MAP_FAILED == cq_ptr) ? nullptr : cq_ptr;
+		sqes = (MAP_FAILED == sqes_ptr) ? nullptr : (struct io_uring_sqe *)sqes_ptr;
+		return -1;
+	}
+
+	sq_head = (unsigned *)((char *)sq_ptr + p.sq_off.head);
+	sq_tail = (unsigned *)((char *)sq_ptr + p.sq_off.tail);
+	sq_array = (unsigned *)((char *)sq_ptr + p.sq_off.array);
+	sq_mask = *(unsigned *)((char *)sq_ptr + p.sq_off.ring_mask);
+	sq_entries = p.sq_entries;
+	sqe_tail = *sq_tail;
+	cq_head = (unsigned *)((char *)cq_ptr + p.cq_off.head);
+	cq_tail = (unsigned *)((char *)cq_ptr + p.cq_off.tail);
+	cq_mask = *(unsigned *)((char *)cq_ptr + p.cq_off.ring_mask);
+	cqes = (struct io_uring_cqe *)((char *)cq_ptr + p.cq_off.cqes);
+	sqes = (struct io_uring_sqe *)sqes_ptr;
+	ext_arg = p.features & IORING_FEAT_EXT_ARG;
+
+	return 0;
+}
+
+struct io_uring_sqe *Uring_ring::get_sqe()
+{
+	if (sqe_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) >= sq_entries) {
+		return nullptr;
+	}
+
+	struct io_uring_sqe *sqe = &sqes[sqe_tail & sq_mask];
+	sq_array[sqe_tail & sq_mask] = sqe_tail & sq_mask;
+	++sqe_tail;
+	memset(sqe, 0, sizeof(*sqe));
+	return sqe;
+}
+
+int Uring_ring::submit(unsigned wait_nr, int timeout_ms)
+{
+	unsigned to_submit = sqe_tail - *sq_tail;
+	__atomic_store_n(sq_tail, sqe_tail, __ATOMIC_RELEASE);
+
+	if (0 == to_submit && 0 == wait_nr) {
+		return 0;
+	}
+
+	unsigned flags = wait_nr ? IORING_ENTER_GETEVENTS : 0;
+
+	if (wait_nr && timeout_ms >= 0) {
+		if (ext_arg) {
+			// Submit and wait with a timeout in the same call
+			struct __kernel_timespec ts = {timeout_ms / 1000, (timeout_ms % 1000) * 1000000LL};
+			struct io_uring_getevents_arg arg;
+			memset(&arg, 0, sizeof(arg));
+			arg.ts = (uint64_t)(uintptr_t)&ts;
+			return syscall(__NR_io_uring_enter, fd, to_submit, wait_nr, flags | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+		}
+
+		// Kernels before 5.11 cannot time out io_uring_enter, poll the ring instead
+		if (to_submit > 0 && 0 > syscall(__NR_io_uring_enter, fd, to_submit, 0, 0, nullptr, 0)) {
+			return -1;
+		}
+
+		struct pollfd pfd = {fd, POLLIN, 0};
+		int ret = poll(&pfd, 1, timeout_ms);
+
+		if (ret <= 0) {
+			errno = (0 == ret) ? ETIME : errno;
+			return -1;
+		}
+
+		return to_submit;
+	}
+
+	return syscall(__NR_io_uring_enter, fd, to_submit, wait_nr, flags, nullptr, 0);
+}
+
+struct io_uring_cqe *Uring_ring::peek_cqe()
+{
+	unsigned head = *cq_head;
+
+	if (head == __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE)) {
+		return nullptr;
+	}
+
+	return &cqes[head & cq_mask];
+}
+
+void Uring_ring::cqe_seen()
+{
+	__atomic_store_n(cq_head, *cq_head + 1, __ATOMIC_RELEASE);
+}
+
+Uring_io::Uring_io(uint32_t _depth, bool _stream):
+	depth(_depth < 1 ? 1 : _depth),
+	stream(_stream)
+{
+}
+
+Uring_io::~Uring_io()
+{
+	// Reads stay in flight on the slots until cancelled, so they are reaped before the slots are freed
+	closing = true;
+
+	if (-1 != rx_ring.fd) {
+		for (uint32_t slot = 0; slot < depth; ++slot) {
+			struct io_uring_sqe *sqe = rx_ring.get_sqe();
+
+			if (nullptr != sqe) {
+				sqe->opcode = IORING_OP_ASYNC_CANCEL;
+				sqe->addr = slot;
+				sqe->user_data = URING_CANCEL;
+			}
+		}
+
+		while (rx_inflight > 0 && 0 <= rx_ring.submit(1, 100)) {
+			reap_rx();
+		}
+	}
+
+	if (-1 != tx_ring.fd) {
+		while (tx_inflight > 0 && 0 <= tx_ring.submit(1, 100)) {
+			reap_tx();
+		}
+	}
+
+	rx_ring.teardown();
+	tx_ring.teardown();
+
+	free(slots);
+	delete[] rx_done;
+	delete[] rx_len;
+	delete[] tx_free;
+	delete[] tx_pending;
+	delete[] tx_len;
+	delete[] tx_offset;
+}
+
+int Uring_io::init(int _rx_fd, int _tx_fd)
+{
+	rx_fd = _rx_fd;
+	tx_fd = _tx_fd;
+
+	// Reads and writes use separate halves of the slot buffers
+	if (0 > rx_ring.setup(depth * 2) || 0 > tx_ring.setup(depth) ||
+	    0 != posix_memalign((void **)&slots, 4096, 2 * depth * BUFFER_SIZE)) {
+#ifndef PX4_ERR
+		printf("\033[0;31m[ micrortps_transport ]\tio_uring setup failed (%d)\033[0m\n", errno);
+#else
+		PX4_ERR("io_uring setup failed (%d)", errno);
+#endif /* PX4_ERR */
+		return -1;
+	}
+
+	struct iovec buffers = {slots, 2 * depth * BUFFER_SIZE};
+	fixed_buffers = (0 == syscall(__NR_io_uring_register, rx_ring.fd, IORING_REGISTER_BUFFERS, &buffers, 1) &&
+			 0 == syscall(__NR_io_uring_register, tx_ring.fd, IORING_REGISTER_BUFFERS, &buffers, 1));
+
+	rx_done = new uint32_t[depth];
+	rx_len = new uint32_t[depth];
+	tx_free = new uint32_t[depth];
+	tx_pending = new uint32_t[depth];
+	tx_len = new uint32_t[depth];
+	tx_offset = new uint32_t[depth];
+
+	for (uint32_t slot = 0; slot < depth; ++slot) {
+		tx_free[tx_free_count++] = slot;
+		queue_read(slot);
+	}
+
+	return (0 > rx_ring.submit()) ? -1 : 0;
+}
+
+bool Uring_io::queue_read(uint32_t slot)
+{
+	struct io_uring_sqe *sqe = rx_ring.get_sqe();
+
+	if (nullptr == sqe) {
+		return false;
+	}
+
+	sqe->opcode = fixed_buffers ? IORING_OP_READ_FIXED : IORING_OP_READ;
+	sqe->fd = rx_fd;
+	sqe->addr = (uint64_t)(uintptr_t)(slots + slot * BUFFER_SIZE);
+	sqe->len = BUFFER_SIZE;
+	sqe->off = (uint64_t) -1;
+	sqe->buf_index = 0;
+	sqe->user_data = slot;
+	++rx_inflight;
+	return true;
+}
+
+bool Uring_io::queue_write(uint32_t slot)
+{
+	struct io_uring_sqe *sqe = tx_ring.get_sqe();
+
+	if (nullptr == sqe) {
+		return false;
+	}
+
+	sqe->opcode = fixed_buffers ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+	sqe->fd = tx_fd;
+	sqe->addr = (uint64_t)(uintptr_t)(slots + (depth + slot) * BUFFER_SIZE + tx_offset[slot]);
+	sqe->len = tx_len[slot] - tx_offset[slot];
+	sqe->off = (uint64_t) -1;
+	sqe->buf_index = 0;
+	sqe->user_data = slot;
+	++tx_inflight;
+	return true;
+}
+
+bool Uring_io::rx_retry(int res) const
+{
+	switch (res) {
+	case 0:
+		// End of file on a stream, an empty datagram otherwise
+		return !stream;
+
+	case -EAGAIN:
+	case -EINTR:
+		return true;
+
+	case -ECONNREFUSED:
+		// ICMP error queued on a datagram socket, which keeps receiving
+		return !stream;
+
+	default:
+		return false;
+	}
+}
+
+void Uring_io::reap_rx()
+{
+	struct io_uring_cqe *cqe;
+
+	while (nullptr != (cqe = rx_ring.peek_cqe())) {
+		uint64_t slot = cqe->user_data;
+		int res = cqe->res;
+		rx_ring.cqe_seen();
+
+		if (URING_CANCEL == slot) {
+			continue;
+		}
+
+		--rx_inflight;
+
+		if (res <= 0) {
+			// Nothing landed in the slot, read into it again unless the ring is being torn down or the link is gone
+			if (closing || 0 != rx_failed) {
+				continue;
+			}
+
+			if (rx_retry(res)) {
+				rx_error = res ? -res : rx_error;
+				queue_read(slot);
+
+			} else {
+				rx_failed = res ? -res : EPIPE;
+#ifndef PX4_ERR
+				printf("\033[0;31m[ micrortps_transport ]\tio_uring: link %s (%d), no longer reading it\033[0m\n",
+				       res ? "failed" : "closed", rx_failed);
+#else
+				PX4_ERR("io_uring: link %s (%d), no longer reading it", res ? "failed" : "closed", rx_failed);
+#endif /* PX4_ERR */
+			}
+
+			continue;
+		}
+
+		rx_len[slot] = res;
+		rx_done[(rx_done_head + rx_done_count++) % depth] = slot;
+	}
+}
+
+void Uring_io::reap_tx()
+{
+	struct io_uring_cqe *cqe;
+
+	while (nullptr != (cqe = tx_ring.peek_cqe())) {
+		uint32_t slot = cqe->user_data;
+		int res = cqe->res;
+		tx_ring.cqe_seen();
+		--tx_inflight;
+
+		if (res > 0 && stream && tx_offset[slot] + res < tx_len[slot]) {
+			// Short write on a byte stream: send the rest before anything queued after it
+			tx_offset[slot] += res;
+			tx_pending_head = (tx_pending_head + depth - 1) % depth;
+			tx_pending[tx_pending_head] = slot;
+			++tx_pending_count;
+			continue;
+		}
+
+		// A failed write is dropped, as a failed write() would drop its frame
+		tx_free[tx_free_count++] = slot;
+	}
+
+	while (tx_pending_count > 0 && (!stream || 0 == tx_inflight)) {
+		if (!queue_write(tx_pending[tx_pending_head])) {
+			break;
+		}
+
+		tx_pending_head = (tx_pending_head + 1) % depth;
+		--tx_pending_count;
+	}
+}
+
+ssize_t Uring_io::read(const struct iovec *iov, int iovcnt, int timeout_ms)
+{
+	reap_rx();
+
+	if (0 == rx_done_count && 0 != rx_failed) {
+		// Fails like a dead device would, but only after the timeout, so that a polling caller does not spin
+		if (0 < timeout_ms) {
+			poll(nullptr, 0, timeout_ms);
+		}
+
+		errno = rx_failed;
+		return -1;
+	}
+
+	if (0 == rx_done_count && 0 != timeout_ms) {
+		// Hand back resubmitted reads and wait for one to complete in the same call
+		if (0 > rx_ring.submit(1, timeout_ms)) {
+			return (ETIME == errno || EINTR == errno) ? 0 : -1;
+		}
+
+		reap_rx();
+	}
+
+	ssize_t copied = 0;
+	int seg = 0;
+	size_t seg_offset = 0;
+
+	while (rx_done_count > 0 && seg < iovcnt) {
+		uint32_t slot = rx_done[rx_done_head];
+		size_t avail = rx_len[slot] - rx_offset;
+		size_t room = iov[seg].iov_len - seg_offset;
+		size_t n = (avail < room) ? avail : room;
+
+		memcpy((char *)iov[seg].iov_base + seg_offset, slots + slot * BUFFER_SIZE + rx_offset, n);
+		copied += n;
+		seg_offset += n;
+		rx_offset += n;
+
+		if (rx_offset == rx_len[slot]) {
+			// Drained: put the slot back in flight
+			rx_done_head = (rx_done_head + 1) % depth;
+			--rx_done_count;
+			rx_offset = 0;
+			queue_read(slot);
+		}
+
+		if (seg_offset == iov[seg].iov_len) {
+			++seg;
+			seg_offset = 0;
+		}
+	}
+
+	rx_ring.submit();
+
+	if (0 == copied && 0 != rx_error) {
+		errno = rx_error;
+		rx_error = 0;
+		return -1;
+	}
+
+	return copied;
+}
+
+ssize_t Uring_io::write(const struct iovec *iov, int iovcnt)
+{
+	size_t len = 0;
+
+	for (int i = 0; i < iovcnt; ++i) {
+		len += iov[i].iov_len;
+	}
+
+	if (len > BUFFER_SIZE) {
+		errno = EMSGSIZE;
+		return -1;
+	}
+
+	reap_tx();
+
+	// Every slot still in flight: wait for the link to take one
+	while (0 == tx_free_count) {
+		if (0 > tx_ring.submit(1)) {
+			return -1;
+		}
+
+		reap_tx();
+	}
+
+	uint32_t slot = tx_free[--tx_free_count];
+	char *dst = slots + (depth + slot) * BUFFER_SIZE;
+
+	for (int i = 0; i < iovcnt; ++i) {
+		memcpy(dst, iov[i].iov_base, iov[i].iov_len);
+		dst += iov[i].iov_len;
+	}
+
+	tx_len[slot] = len;
+	tx_offset[slot] = 0;
+
+	if (stream && (tx_inflight > 0 || tx_pending_count > 0)) {
+		// Byte stream writes go out in order, one at a time
+		tx_pending[(tx_pending_head + tx_pending_count++) % depth] = slot;
+
+	} else {
+		queue_write(slot);
+	}
+
+	return (0 > tx_ring.submit()) ? -1 : (ssize_t)len;
+}
+
+ssize_t Uring_io::flush()
+{
+	reap_tx();
+
+	while (tx_pending_count > 0) {
+		if (0 > tx_ring.submit(1)) {
+			return -1;
+		}
+
+		reap_tx();
+	}
+
+	return (0 > tx_ring.submit()) ? -1 : 0;
+}
+
+UART_uring_node::UART_uring_node(const char *_uart_name, const uint32_t _baudrate,
+				 const uint32_t _poll_ms, const bool _hw_flow_control,
+				 const bool _sw_flow_control, const bool _debug, const uint32_t _depth):
+	UART_node(_uart_name, _baudrate, _poll_ms, _hw_flow_control, _sw_flow_control, _debug),
+	uring(_depth, true)
+{
+}
+
+int UART_uring_node::init()
+{
+	if (0 > UART_node::init()) {
+		return -1;
+	}
+
+	// io_uring fails requests on O_NONBLOCK files with EAGAIN instead of waiting for them in the kernel
+	int flags = fcntl(uart_fd, F_GETFL);
+
+	if (0 > flags || 0 > fcntl(uart_fd, F_SETFL, flags & ~O_NONBLOCK)) {
+		return -1;
+	}
+
+	return uring.init(uart_fd, uart_fd);
+}
+
+ssize_t UART_uring_node::node_read(const struct iovec *iov, int iovcnt)
+{
+	if (nullptr == iov || !fds_OK()) {
+		return -1;
+	}
+
+	return uring.read(iov, iovcnt, rx_nonblocking ? 0 : poll_ms);
+}
+
+ssize_t UART_uring_node::node_write(const struct iovec *iov, int iovcnt)
+{
+	if (nullptr == iov || !fds_OK()) {
+		return -1;
+	}
+
+	return uring.write(iov, iovcnt);
+}
+
+ssize_t UART_uring_node::node_flush()
+{
+	return uring.flush();
+}
+
+UDP_uring_node::UDP_uring_node(const char *_udp_ip, uint16_t _udp_port_recv, uint16_t _udp_port_send,
+			       const bool _debug, const uint32_t _depth):
+	UDP_node(_udp_ip, _udp_port_recv, _udp_port_send, _debug),
+	uring(_depth, false)
+{
+}
+
+int UDP_uring_node::init()
+{
+	if (0 > UDP_node::init()) {
+		return -1;
+	}
+
+	// Plain writes carry no address, so the sender is bound to its one destination
+	if (0 > connect(sender_fd, (struct sockaddr *)&sender_outaddr, sizeof(sender_outaddr))) {
+#ifndef PX4_ERR
+		printf("\033[0;31m[ micrortps_transport ]\tUDP transport: connect() failed\033[0m\n");
+#else
+		PX4_ERR("UDP transport: connect() failed");
+#endif /* PX4_ERR */
+		return -1;
+	}
+
+	return uring.init(receiver_fd, sender_fd);
+}
+
+ssize_t UDP_uring_node::node_read(const struct iovec *iov, int iovcnt)
+{
+	if (nullptr == iov || !fds_OK()) {
+		return -1;
+	}
+
+	return uring.read(iov, iovcnt, rx_nonblocking ? 0 : -1);
+}
+
+ssize_t UDP_uring_node::node_write(const struct iovec *iov, int iovcnt)
+{
+	if (nullptr == iov || !fds_OK()) {
+		return -1;
+	}
+
+	return uring.write(iov, iovcnt);
+}
+
+ssize_t UDP_uring_node::node_flush()
+{
+	return uring.flush();
+}
+
+#endif /* MICRORTPS_IO_URING */
@@ -36,11 +36,35 @@
 #include <cstring>
 #include <arpa/inet.h>
 #include <poll.h>
+#include <pthread.h>
 #include <termios.h>
+#include <sys/uio.h>
+
+/*
+ * The io_uring link I/O is built for the agent only, like the sliced CRC engines: the client, built within PX4, keeps
+ * the plain read and write calls of its NuttX and POSIX targets.
+ */
+#if defined(__linux__) && __has_include(<linux/io_uring.h>) && !__has_include("px4_platform_common/log.h")
+#define MICRORTPS_IO_URING 1
+#endif
 
 #define BUFFER_SIZE 1024
 #define DEFAULT_UART "/dev/ttyACM0"
 
+/**
+ * Bytes and frames dropped by the frame parser of a link. Not by topic, as the topic ID of a frame dropped is not to be
+ * trusted. Only the thread decoding the link writes them, with relaxed atomic stores, so any thread may read them with load()
+ */
+struct RxDropCounters {
+	uint32_t garbage_bytes;          ///< Bytes skipped looking for a frame marker
+	uint32_t crc_errors;
+	uint32_t oversize;               ///< Frames too large for the decode buffer
+	uint32_t seq_gaps;               ///< Frames missing from the sequence numbers of the sender
+
+	static void add(uint32_t &counter, uint32_t n) { __atomic_store_n(&counter, counter + n, __ATOMIC_RELAXED); }
+	static uint32_t load(const uint32_t &counter) { return __atomic_load_n(&counter, __ATOMIC_RELAXED); }
+};
+
 class Transport_node
 {
 public:
@@ -51,11 +75,88 @@ public:
 	virtual uint8_t close() {return 0;}
 	ssize_t read(uint8_t *topic_ID, char out_buffer[], size_t buffer_len);
 
+	/**
+	 * read once from the link and decode every complete frame buffered after that, so high-rate streams
+	 * cost one node_read per batch rather than one per frame
+	 * @param out_buffer buffer each payload is copied to before calling on_frame. on_frame may point it to another
+	 *        buffer of buffer_len bytes, e.g. after keeping the one just filled, and the next frame is decoded there
+	 * @param buffer_len out_buffer length
+	 * @param on_frame callable as on_frame(topic_ID, out_buffer, payload_length) for each decoded frame
+	 * @return number of frames decoded, <0 on read error
+	 */
+	template <typename Callback>
+	ssize_t read_batch(char *&out_buffer, size_t buffer_len, Callback &&on_frame)
+	{
+		if (nullptr == out_buffer || !fds_OK()) {
+			return -1;
+		}
+
+		ssize_t len = rx_fill();
+
+		if (len < 0) {
+			return len;
+		}
+
+		ssize_t frames = 0;
+		uint8_t topic_ID = 255;
+
+		// Negative results dropped garbage, a bad CRC or an oversized frame, and always consume bytes
+		while (rx_parsable() && 0 != (len = parse_frame(&topic_ID, out_buffer, buffer_len))) {
+			if (len > 0) {
+				on_frame(topic_ID, out_buffer, len - get_header_length());
+				++frames;
+			}
+		}
+
+		return frames;
+	}
+
+	/**
+	 * read once from the link without decoding, for a reader thread that hands the bytes over to the thread
+	 * decoding them with parse_batch()
+	 * @param buffer buffer to read to
+	 * @param len buffer length
+	 * @return number of bytes read, <0 on read error
+	 */
+	ssize_t read_raw(char buffer[], size_t len);
+
+	/**
+	 * decode every complete frame in bytes read by read_raw(), along with those left over from earlier calls
+	 * @param data bytes read from the link
+	 * @param len number of bytes
+	 * @param out_buffer, buffer_len, on_frame as for read_batch()
+	 * @return number of frames decoded
+	 */
+	template <typename Callback>
+	ssize_t parse_batch(const char data[], size_t len, char *&out_buffer, size_t buffer_len, Callback &&on_frame)
+	{
+		ssize_t frames = 0;
+		uint8_t topic_ID = 255;
+
+		while (len > 0) {
+			// Append what fits, then parse: a full ring always holds a complete, bad or oversized frame
+			size_t copied = rx_push(data, len);
+			data += copied;
+			len -= copied;
+
+			ssize_t ret;
+
+			while (rx_parsable() && 0 != (ret = parse_frame(&topic_ID, out_buffer, buffer_len))) {
+				if (ret > 0) {
+					on_frame(topic_ID, out_buffer, ret - get_header_length());
+					++frames;
+				}
+			}
+		}
+
+		return frames;
+	}
+
 	/**
 	 * write a buffer
 	 * @param topic_ID
-	 * @param buffer buffer to write: it must leave get_header_length() bytes free at the beginning. This will be
-	 *               filled with the header. length does not include get_header_length(). So buffer looks like this:
+	 * @param buffer buffer to write: it must leave get_header_length() bytes free at the beginning. The headroom is
+	 *               no longer touched, the payload after it is sent as with write_payload(). So buffer looks like this:
 	 *                -------------------------------------------------
 	 *               | header (leave free)          | payload data     |
 	 *               | get_header_length() bytes    | length bytes     |
@@ -65,21 +166,107 @@ public:
 	 */
 	ssize_t write(const uint8_t topic_ID, char buffer[], size_t length);
 
+	/**
+	 * write a payload with no headroom. The header is built in its own buffer and sent with the payload as one
+	 * scatter-gather write, so the payload is never copied or modified. Safe to call from several threads.
+	 * @param topic_ID
+	 * @param payload serialized payload
+	 * @param length payload length
+	 * @return length on success, <0 on error
+	 */
+	ssize_t write_payload(const uint8_t topic_ID, const char payload[], size_t length);
+
 	/** Get the Length of struct Header to make headroom for the size of struct Header along with payload */
 	size_t get_header_length();
 
+	/**
+	 * push out anything a batching link is still holding back. Called by the sender when it runs out of messages
+	 * @return number of bytes sent, <0 on error
+	 */
+	ssize_t flush();
+
+	/** fd that becomes readable when the link has data, for callers running their own event loop. -1 if none */
+	virtual int get_rx_fd() {return -1;}
+
+	/**
+	 * make reads return at once when the link has no data instead of waiting for it, for callers that only read
+	 * after get_rx_fd() polled readable
+	 */
+	void set_rx_nonblocking(bool nonblocking) { rx_nonblocking = nonblocking; }
+
+	/** true if data already taken off get_rx_fd() is still waiting to be read, so polling it would not report it */
+	virtual bool rx_pending() {return false;}
+
+	/** count what the frame parser drops in counters, zeroed by the caller and outliving the node. nullptr stops */
+	void set_rx_drop_counters(RxDropCounters *counters) { rx_drops = counters; }
+
 protected:
-	virtual ssize_t node_read(void *buffer, size_t len) = 0;
-	virtual ssize_t node_write(void *buffer, size_t len) = 0;
+	/**
+	 * read into a scatter list, so the receive ring can be filled across its wrap point with a single call
+	 * @param iov segments to fill, in order
+	 * @param iovcnt number of segments
+	 * @return number of bytes read, <0 on error
+	 */
+	virtual ssize_t node_read(const struct iovec *iov, int iovcnt) = 0;
+	/**
+	 * write a gather list as one frame. Called with the write lock held
+	 * @param iov segments to write, in order
+	 * @param iovcnt number of segments
+	 * @return number of bytes written, <0 on error
+	 */
+	virtual ssize_t node_write(const struct iovec *iov, int iovcnt) = 0;
+
+	/** send anything node_write is still holding back. Called with the write lock held */
+	virtual ssize_t node_flush() {return 0;}
 	virtual bool fds_OK() = 0;
 	uint16_t crc16_byte(uint16_t crc, const uint8_t data);
-	uint16_t crc16(uint8_t const *buffer, size_t len);
+	uint16_t crc16(uint8_t const *buffer, size_t len, uint16_t crc = 0);
+
+	/** node_read into the free space at the end of the receive buffer */
+	ssize_t rx_fill();
+
+	/** Report a failed node_read, unless it would only have blocked or timed out. Out of line, as it is rare */
+	void rx_read_failed() const;
+
+	/** Copy into the free space at the end of the receive buffer, returns the number of bytes copied */
+	size_t rx_push(const char *data, size_t len);
+
+	/** Move the unparsed bytes to the start of the receive buffer, once that frees more than is left at its end */
+	void rx_compact();
+
+	/**
+	 * decode the next frame from the receive buffer, without reading from the link
+	 * @return frame length (header included) on success, 0 if no complete frame is buffered, <0 if bytes were dropped
+	 */
+	ssize_t parse_frame(uint8_t *topic_ID, char out_buffer[], size_t buffer_len);
+
+	/** Number of buffered bytes not yet consumed by the frame parser */
+	inline uint32_t rx_buff_count() const { return rx_tail - rx_head; }
+
+	/** false if parse_frame() would find no complete frame, checked inline as it is most of the calls for short reads */
+	inline bool rx_parsable() const { return rx_buff_count() >= rx_wanted; }
+
+	/** Offset from rx_head of the first ">>>" marker starting before limit, or limit if there is none */
+	uint32_t rx_find_marker(uint32_t limit) const;
 
 protected:
-	uint32_t rx_buff_pos;
+	/**
+	 * Receive buffer. Bytes from rx_head to rx_tail are buffered and not parsed yet. Frames are parsed where they
+	 * landed and consuming a frame or garbage only moves rx_head, so every frame is contiguous. rx_compact() moves
+	 * what is left, at most a partial frame, back to the start once the end of the buffer is reached.
+	 */
+	uint32_t rx_head;
+	uint32_t rx_tail;
+	uint32_t rx_wanted{sizeof(struct Header)}; ///< Buffered bytes parse_frame() needs to make progress: a header, or the frame it found incomplete
 	char rx_buffer[BUFFER_SIZE] = {};
 	bool debug = false;
+	bool rx_nonblocking = false;
 	uint8_t _seq_number{0};
+	RxDropCounters *rx_drops{nullptr};
+	int rx_seq_expected{-1}; ///< Sequence number of the next frame, -1 until a frame is received
+
+	/** Serializes writers so the sequence number and link writes of concurrent senders do not interleave */
+	pthread_mutex_t tx_mutex;
 
 private:
 	struct __attribute__((packed)) Header {
@@ -103,10 +290,11 @@ public:
 
 	int init();
 	uint8_t close();
+	int get_rx_fd() { return uart_fd; }
 
 protected:
-	ssize_t node_read(void *buffer, size_t len);
-	ssize_t node_write(void *buffer, size_t len);
+	ssize_t node_read(const struct iovec *iov, int iovcnt);
+	ssize_t node_write(const struct iovec *iov, int iovcnt);
 	bool fds_OK();
 	bool baudrate_to_speed(uint32_t bauds, speed_t *speed);
 
@@ -122,18 +310,25 @@ protected:
 class UDP_node: public Transport_node
 {
 public:
+	/**
+	 * @param _batch_size datagrams moved per recvmmsg/sendmmsg call. 1 keeps one syscall per datagram
+	 * @param _batch_timeout_us longest time a written datagram may wait in a partial send batch
+	 */
 	UDP_node(const char* _udp_ip, uint16_t udp_port_recv, uint16_t udp_port_send,
-			 const bool _debug);
+			 const bool _debug, uint32_t _batch_size = 1, uint32_t _batch_timeout_us = 0);
 	virtual ~UDP_node();
 
 	int init();
 	uint8_t close();
+	int get_rx_fd() { return receiver_fd; }
+	bool rx_pending() { return rx_msg_pos < rx_msg_count; }
 
 protected:
 	int init_receiver(uint16_t udp_port);
 	int init_sender(uint16_t udp_port);
-	ssize_t node_read(void *buffer, size_t len);
-	ssize_t node_write(void *buffer, size_t len);
+	ssize_t node_read(const struct iovec *iov, int iovcnt);
+	ssize_t node_write(const struct iovec *iov, int iovcnt);
+	ssize_t node_flush();
 	bool fds_OK();
 
 	int sender_fd;
@@ -144,4 +339,188 @@ protected:
 	struct sockaddr_in sender_outaddr;
 	struct sockaddr_in receiver_inaddr;
 	struct sockaddr_in receiver_outaddr;
+
+	uint32_t batch_size;
+	uint32_t batch_timeout_us;
+
+	// Datagrams received by the last recvmmsg, handed to the receive ring as it frees up
+	char *rx_slots = nullptr;
+	struct iovec *rx_slot_iovs = nullptr;
+	struct mmsghdr *rx_msgs = nullptr;
+	uint32_t rx_msg_count = 0;
+	uint32_t rx_msg_pos = 0;
+	size_t rx_msg_offset = 0;
+
+	// Datagrams written since the last sendmmsg
+	char *tx_slots = nullptr;
+	struct iovec *tx_slot_iovs = nullptr;
+	struct mmsghdr *tx_msgs = nullptr;
+	uint32_t tx_msg_count = 0;
+	uint64_t tx_first_us = 0;
+};
+
+#ifdef MICRORTPS_IO_URING
+
+/** Minimal io_uring submission/completion queue pair over the kernel ABI, so no liburing is needed */
+class Uring_ring
+{
+public:
+	Uring_ring() = default;
+	~Uring_ring();
+
+	int setup(unsigned entries);
+	void teardown();
+
+	/** next free submission entry, zeroed, or nullptr if the queue is full. Handed to the kernel by submit() */
+	struct io_uring_sqe *get_sqe();
+
+	/**
+	 * submit the entries taken so far and optionally wait for completions
+	 * @param wait_nr completions to wait for
+	 * @param timeout_ms longest wait, -1 for no limit
+	 * @return number of entries submitted, <0 on error or timeout
+	 */
+	int submit(unsigned wait_nr = 0, int timeout_ms = -1);
+
+	/** oldest completion, or nullptr if there is none. Release it with cqe_seen() */
+	struct io_uring_cqe *peek_cqe();
+	void cqe_seen();
+
+	int fd = -1;
+
+private:
+	void *sq_ptr = nullptr;
+	void *cq_ptr = nullptr;
+	size_t sq_len = 0;
+	size_t cq_len = 0;
+	size_t sqes_len = 0;
+	unsigned *sq_head = nullptr;
+	unsigned *sq_tail = nullptr;
+	unsigned *sq_array = nullptr;
+	unsigned sq_mask = 0;
+	unsigned sq_entries = 0;
+	unsigned sqe_tail = 0;
+	unsigned *cq_head = nullptr;
+	unsigned *cq_tail = nullptr;
+	unsigned cq_mask = 0;
+	struct io_uring_sqe *sqes = nullptr;
+	struct io_uring_cqe *cqes = nullptr;
+	bool ext_arg = false;
+};
+
+/**
+ * io_uring reads and writes through registered buffers. depth reads are kept in flight on the receive fd and
+ * writes are queued to the kernel without waiting for them. Each direction has its own ring, so the receiving
+ * and the sending thread never share one.
+ */
+class Uring_io
+{
+public:
+	/**
+	 * @param _depth reads kept in flight, and writes that may be queued before write() waits
+	 * @param _stream byte stream link: writes go out one at a time, in order, and short writes are resumed
+	 */
+	Uring_io(uint32_t _depth, bool _stream);
+	~Uring_io();
+
+	int init(int rx_fd, int tx_fd);
+
+	/**
+	 * copy completed reads into a scatter list, waiting up to timeout_ms for one if none is completed yet
+	 * @return number of bytes copied, 0 on timeout, <0 on error
+	 */
+	ssize_t read(const struct iovec *iov, int iovcnt, int timeout_ms);
+
+	/** queue a gathered write. Only waits if all depth write buffers are still in flight */
+	ssize_t write(const struct iovec *iov, int iovcnt);
+
+	/** wait until every queued write is handed to the link */
+	ssize_t flush();
+
+	/** ring fd, readable when a read completed */
+	int get_rx_fd() { return rx_ring.fd; }
+	bool rx_pending() { return rx_done_count > 0 || nullptr != rx_ring.peek_cqe(); }
+
+private:
+	bool queue_read(uint32_t slot);
+	bool queue_write(uint32_t slot);
+	/** true if a read that completed with res should just be read again, false if the link is gone */
+	bool rx_retry(int res) const;
+	void reap_rx();
+	void reap_tx();
+
+	uint32_t depth;
+	bool stream;
+	bool fixed_buffers = false;
+	bool closing = false;
+	int rx_fd = -1;
+	int tx_fd = -1;
+	Uring_ring rx_ring;
+	Uring_ring tx_ring;
+
+	// Slot buffers, registered with both rings as buffer 0
+	char *slots = nullptr;
+
+	// Completed reads in completion order, which is the order the link delivered their data in
+	uint32_t *rx_done = nullptr;
+	uint32_t rx_done_head = 0;
+	uint32_t rx_done_count = 0;
+	uint32_t *rx_len = nullptr;
+	uint32_t rx_offset = 0;
+	int rx_error = 0;
+	int rx_failed = 0; // errno that ended the link, after which no read is queued again
+
+	// Write slots: free stack, and pending queue of slots not handed to the kernel yet
+	uint32_t *tx_free = nullptr;
+	uint32_t tx_free_count = 0;
+	uint32_t *tx_pending = nullptr;
+	uint32_t tx_pending_head = 0;
+	uint32_t tx_pending_count = 0;
+	uint32_t *tx_len = nullptr;
+	uint32_t *tx_offset = nullptr;
+	uint32_t tx_inflight = 0;
+	uint32_t rx_inflight = 0;
+
+	static constexpr uint64_t URING_CANCEL = ~0ULL;
+};
+
+/** UART_node reading and writing through io_uring instead of poll/readv/writev */
+class UART_uring_node: public UART_node
+{
+public:
+	UART_uring_node(const char *_uart_name, const uint32_t _baudrate,
+			const uint32_t _poll_ms, const bool _hw_flow_control,
+			const bool _sw_flow_control, const bool _debug, const uint32_t _depth);
+
+	int init();
+	int get_rx_fd() { return uring.get_rx_fd(); }
+	bool rx_pending() { return uring.rx_pending(); }
+
+protected:
+	ssize_t node_read(const struct iovec *iov, int iovcnt);
+	ssize_t node_write(const struct iovec *iov, int iovcnt);
+	ssize_t node_flush();
+
+	Uring_io uring;
+};
+
+/** UDP_node reading and writing through io_uring instead of recvmsg/sendmsg */
+class UDP_uring_node: public UDP_node
+{
+public:
+	UDP_uring_node(const char *_udp_ip, uint16_t udp_port_recv, uint16_t udp_port_send,
+		       const bool _debug, const uint32_t _depth);
+
+	int init();
+	int get_rx_fd() { return uring.get_rx_fd(); }
+	bool rx_pending() { return uring.rx_pending(); }
+
+protected:
+	ssize_t node_read(const struct iovec *iov, int iovcnt);
+	ssize_t node_write(const struct iovec *iov, int iovcnt);
+	ssize_t node_flush();
+
+	Uring_io uring;
 };
+
+#endif /* MICRORTPS_IO_URING */
@@ -0,0 +1,188 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2020 PX4 Development Team. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+
+
+/*!
+ * @file crc16_bench.cpp
+ * @brief CRC-16 throughput: times crc16_byte() one byte at a time, and every engine the transport has for the
+ *        running CPU, over payloads from 8 bytes up to the largest that fits a frame. Prints the MB/s of each, and
+ *        exits non-zero if they do not compute the same CRCs
+ */
+
+// Built with the transport itself, to reach its file-local engines
+#include "microRTPS_transport.cpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+class CrcNode: public Transport_node
+{
+public:
+	CrcNode(): Transport_node(false) {}
+
+	uint16_t bytewise(const uint8_t *buffer, size_t len, uint16_t crc)
+	{
+		while (len--) {
+			crc = crc16_byte(crc, *buffer++);
+		}
+
+		return crc;
+	}
+
+protected:
+	ssize_t node_read(const struct iovec *, int) { return 0; }
+	ssize_t node_write(const struct iovec *, int) { return 0; }
+	bool fds_OK() { return true; }
+};
+
+namespace
+{
+
+CrcNode node;
+
+uint16_t crc16_bytewise(const uint8_t *buffer, size_t len, uint16_t crc) { return node.bytewise(buffer, len, crc); }
+
+struct Engine {
+	const char *name;
+	uint16_t (*crc16)(const uint8_t *, size_t, uint16_t);
+};
+
+/** Best of rounds, each over about 4 MB of payloads of len bytes laid back to back */
+bool run(const std::vector<uint8_t> &data, size_t len, unsigned rounds, const std::vector<Engine> &engines)
+{
+	using clock = std::chrono::steady_clock;
+	const size_t payloads = data.size() / len;
+	const unsigned passes = (4 << 20) / data.size() + 1;
+	uint32_t reference = 0;
+	bool match = true;
+
+	printf("%5zu byte payloads", len);
+
+	for (size_t e = 0; e < engines.size(); ++e) {
+		double best = 0;
+		uint32_t sum = 0;
+
+		for (unsigned round = 0; round < rounds; ++round) {
+			sum = 0;
+			const clock::time_point start = clock::now();
+
+			for (unsigned pass = 0; pass < passes; ++pass) {
+				for (size_t i = 0; i < payloads; ++i) {
+					// Chained through the initial value, so that the CRCs can not overlap or be left out
+					sum += engines[e].crc16(data.data() + i * len, len, (uint16_t)sum);
+				}
+			}
+
+			const double seconds = std::chrono::duration<double>(clock::now() - start).count();
+
+			if (round == 0 || seconds < best) {
+				best = seconds;
+			}
+		}
+
+		printf("  %10.1f", (double)passes * payloads * len / best / 1e6);
+
+		if (e == 0) {
+			reference = sum;
+
+		} else {
+			match &= sum == reference;
+		}
+	}
+
+	printf("\n");
+	return match;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+	const unsigned rounds = (argc > 1) ? atoi(argv[1]) : 20;
+	std::mt19937 rng(0x5eed);
+	std::vector<Engine> engines = {{"crc16_byte", crc16_bytewise}};
+
+#ifdef MICRORTPS_CRC16_SLICED
+	engines.push_back({"slice8", crc16_slice8});
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_cpu_init();
+
+	if (__builtin_cpu_supports("pclmul")) {
+		engines.push_back({"pclmul", crc16_clmul});
+	}
+
+#elif defined(__aarch64__) && defined(__linux__) && defined(HWCAP_PMULL)
+
+	if (getauxval(AT_HWCAP) & HWCAP_PMULL) {
+		engines.push_back({"pmull", crc16_clmul});
+	}
+
+#endif
+#else
+	printf("crc16_bench: built without the sliced engines, C++14 or later off PX4 needed\n");
+#endif /* MICRORTPS_CRC16_SLICED */
+
+	// About 64 KB of payloads, which stay in L2 as a receive buffer's worth of frames stays in cache
+	std::vector<uint8_t> data(64 << 10);
+
+	for (uint8_t &byte : data) {
+		byte = rng();
+	}
+
+	printf("crc16_bench: MB/s, best of %u rounds\n%18s", rounds, "");
+
+	for (const Engine &engine : engines) {
+		printf("  %10s", engine.name);
+	}
+
+	printf("\n");
+	bool match = true;
+
+	for (size_t len : {8, 16, 32, 64, 128, 256, 512}) {
+		match &= run(data, len, rounds, engines);
+	}
+
+	// The payload of the largest frame the receive buffer holds
+	match &= run(data, BUFFER_SIZE - node.get_header_length(), rounds, engines);
+
+	if (!match) {
+		printf("crc16_bench: the engines computed different CRCs\n");
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,140 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2020 PX4 Development Team. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+/*!
+ * @file crc16_test.cpp
+ * @brief Checks every CRC-16 engine of the transport against the bytewise crc16_byte() over random buffers,
+ *        lengths, alignments and initial values. Exits non-zero on the first mismatch
+ */
+
+// Built with the transport itself, to reach its file-local engines
+#include "microRTPS_transport.cpp"
+
+#include <cstdio>
+#include <random>
+#include <vector>
+
+class CrcNode: public Transport_node
+{
+public:
+	CrcNode(): Transport_node(false) {}
+
+	uint16_t bytewise(const uint8_t *buffer, size_t len, uint16_t crc)
+	{
+		while (len--) {
+			crc = crc16_byte(crc, *buffer++);
+		}
+
+		return crc;
+	}
+
+	uint16_t dispatched(const uint8_t *buffer, size_t len, uint16_t crc) { return crc16(buffer, len, crc); }
+
+protected:
+	ssize_t node_read(const struct iovec *, int) { return 0; }
+	ssize_t node_write(const struct iovec *, int) { return 0; }
+	bool fds_OK() { return true; }
+};
+
+int main()
+{
+	CrcNode node;
+	std::mt19937 rng(0x5eed);
+	std::vector<uint8_t> data(2200 + 16);
+
+	struct Engine {
+		const char *name;
+		uint16_t (*crc16)(const uint8_t *, size_t, uint16_t);
+	};
+	std::vector<Engine> engines;
+#ifdef MICRORTPS_CRC16_SLICED
+	engines.push_back({"slice8", crc16_slice8});
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_cpu_init();
+
+	if (__builtin_cpu_supports("pclmul")) {
+		engines.push_back({"pclmul", crc16_clmul});
+	}
+
+#elif defined(__aarch64__) && defined(__linux__) && defined(HWCAP_PMULL)
+
+	if (getauxval(AT_HWCAP) & HWCAP_PMULL) {
+		engines.push_back({"pmull", crc16_clmul});
+	}
+
+#endif
+#endif /* MICRORTPS_CRC16_SLICED */
+
+	for (uint8_t &byte : data) {
+		byte = rng();
+	}
+
+	// Every length around the 8 and 16 byte steps first, then random ones up to beyond the largest frame
+	for (unsigned i = 0; i < 100000; ++i) {
+		const size_t len = (i < 2200) ? i : rng() % 2200;
+		const size_t offset = rng() % 16;
+		const uint16_t init = (i & 1) ? rng() : 0;
+		const uint8_t *buffer = data.data() + offset;
+		const uint16_t expected = node.bytewise(buffer, len, init);
+
+		if (node.dispatched(buffer, len, init) != expected) {
+			printf("crc16: %04x != %04x (len %zu, offset %zu, init %04x)\n", node.dispatched(buffer, len, init),
+			       expected, len, offset, init);
+			return 1;
+		}
+
+		for (const Engine &engine : engines) {
+			if (engine.crc16(buffer, len, init) != expected) {
+				printf("%s: %04x != %04x (len %zu, offset %zu, init %04x)\n", engine.name,
+				       engine.crc16(buffer, len, init), expected, len, offset, init);
+				return 1;
+			}
+		}
+
+		if (0 == i % 4096) {
+			// Fresh data now and then, the buffers above overlap
+			for (uint8_t &byte : data) {
+				byte = rng();
+			}
+		}
+	}
+
+	printf("crc16: dispatched");
+
+	for (const Engine &engine : engines) {
+		printf(", %s", engine.name);
+	}
+
+	printf(" match crc16_byte\n");
+	return 0;
+}
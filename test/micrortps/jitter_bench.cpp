@@ -0,0 +1,216 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2020 PX4 Development Team. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+/*!
+ * @file jitter_bench.cpp
+ * @brief Wake-up jitter of a periodic thread, as the link reader and timesync threads wake up, idle and under
+ *        synthetic CPU stress, with the default scheduler and with the agent's -k, -y and -L setup: setup_thread()
+ *        pinning it with a SCHED_FIFO priority, and lock_memory(). Prints how late the thread wakes up
+ */
+
+#include "microRTPS_pipeline.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <sys/wait.h>
+#include <thread>
+#include <time.h>
+#include <vector>
+
+namespace
+{
+
+struct Options {
+	unsigned seconds;
+	unsigned stress_threads;
+	unsigned period_us;
+	int priority;
+};
+
+enum class Mode {
+	Idle,     ///< Default scheduler, nothing else running
+	Stress,   ///< Default scheduler, stress threads spinning
+	Realtime  ///< Stress threads spinning, the thread set up as the agent does with -k, -y and -L
+};
+
+const char *name(Mode mode)
+{
+	switch (mode) {
+	case Mode::Idle: return "idle";
+
+	case Mode::Stress: return "stress";
+
+	case Mode::Realtime: return "stress+rt";
+	}
+
+	return "";
+}
+
+uint64_t ns(const struct timespec &ts)
+{
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/** Stress thread: spins on the CPU and dirties a buffer, so that it also evicts the measured thread's cache lines */
+void spin(const std::atomic<bool> &stop)
+{
+	std::vector<char> buffer(1 << 20);
+	size_t i = 0;
+
+	while (!stop.load(std::memory_order_relaxed)) {
+		buffer[i] = (char)i;
+		i = (i + 4096 + 64) % buffer.size();
+	}
+}
+
+/** One mode, run in its own process as mlockall() and the scheduler settings cannot be undone */
+int measure(Mode mode, const Options &options)
+{
+	const bool realtime = mode == Mode::Realtime;
+	bool locked = false;
+
+	if (realtime) {
+		locked = lock_memory();
+	}
+
+	const size_t samples = (size_t)options.seconds * 1000000 / options.period_us;
+	std::vector<uint64_t> late_ns;
+	late_ns.reserve(samples);
+
+	std::atomic<bool> stop{false};
+	std::vector<std::thread> stress;
+
+	if (mode != Mode::Idle) {
+		for (unsigned i = 0; i < options.stress_threads; ++i) {
+			stress.emplace_back(spin, std::cref(stop));
+		}
+	}
+
+	bool set_up = false;
+
+	std::thread periodic([&] {
+		if (realtime) {
+			ThreadSetup setup;
+			setup.cpu = (int)std::thread::hardware_concurrency() - 1;
+			setup.priority = options.priority;
+			set_up = setup_thread(setup);
+		}
+
+		struct timespec next;
+		clock_gettime(CLOCK_MONOTONIC, &next);
+
+		for (size_t i = 0; i < samples; ++i) {
+			next.tv_nsec += options.period_us * 1000;
+
+			while (next.tv_nsec >= 1000000000) {
+				next.tv_nsec -= 1000000000;
+				++next.tv_sec;
+			}
+
+			clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, nullptr);
+
+			struct timespec now;
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			late_ns.push_back(ns(now) - ns(next));
+		}
+	});
+
+	periodic.join();
+	stop.store(true, std::memory_order_relaxed);
+
+	for (std::thread &thread : stress) {
+		thread.join();
+	}
+
+	std::sort(late_ns.begin(), late_ns.end());
+	const auto percentile = [&](double p) {
+		return late_ns[std::min(late_ns.size() - 1, (size_t)(p * late_ns.size()))] / 1000.0;
+	};
+
+	uint64_t sum = 0;
+
+	for (uint64_t late : late_ns) {
+		sum += late;
+	}
+
+	printf("%-9s  %8s  %5s  %8zu  %8.1f  %8.1f  %8.1f  %8.1f  %9.1f\n", name(mode),
+	       realtime ? (set_up ? "yes" : "FAILED") : "-", realtime ? (locked ? "yes" : "FAILED") : "-",
+	       late_ns.size(), sum / 1000.0 / late_ns.size(), percentile(0.5), percentile(0.99), percentile(0.999),
+	       late_ns.back() / 1000.0);
+
+	// The child leaves with _exit(), which does not flush
+	fflush(stdout);
+	return 0;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+	Options options;
+	options.seconds = (argc > 1) ? atoi(argv[1]) : 10;
+	options.stress_threads = (argc > 2) ? atoi(argv[2]) : 2 * std::thread::hardware_concurrency();
+	options.period_us = (argc > 3) ? atoi(argv[3]) : 1000;
+	options.priority = (argc > 4) ? atoi(argv[4]) : 80;
+
+	if (options.seconds == 0 || options.period_us == 0) {
+		printf("usage: %s [seconds] [stress_threads] [period_us] [priority]\n", argv[0]);
+		return 1;
+	}
+
+	printf("jitter_bench: %u s of %u us periods, %u stress threads, SCHED_FIFO priority %d, %u CPUs\n",
+	       options.seconds, options.period_us, options.stress_threads, options.priority,
+	       std::thread::hardware_concurrency());
+	printf("Wake-up lateness in us\nmode       FIFO+pin  mlock   samples      mean       p50       p99     p99.9        max\n");
+	fflush(stdout);
+
+	int failed = 0;
+
+	for (Mode mode : {Mode::Idle, Mode::Stress, Mode::Realtime}) {
+		const pid_t pid = fork();
+
+		if (pid == 0) {
+			_exit(measure(mode, options));
+		}
+
+		int status = 0;
+
+		if (pid < 0 || waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+			failed = 1;
+		}
+	}
+
+	return failed;
+}
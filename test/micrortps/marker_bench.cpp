@@ -0,0 +1,191 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2020 PX4 Development Team. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+
+/*!
+ * @file marker_bench.cpp
+ * @brief Frame marker search: times every ">>>" scanner the transport has for the running CPU, and the '>' plus
+ *        memcmp() loop the transport had before them, over 1 KB receive windows of a clean stream of frames, of
+ *        100% garbage with no marker, and of garbage full of '>'. Prints the GB/s scanned by each, and exits
+ *        non-zero if they do not find the same markers
+ */
+
+// Built with the transport itself, to reach its file-local scanners
+#include "microRTPS_transport.cpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+namespace
+{
+
+/** The marker search before the scanners, one byte at a time with a memcmp() on every '>' */
+size_t find_marker_memcmp(const char *buf, size_t len)
+{
+	for (size_t i = 0; i + 2 < len; ++i) {
+		if ('>' == buf[i] && 0 == memcmp(buf + i, ">>>", 3)) {
+			return i;
+		}
+	}
+
+	return len;
+}
+
+/** Frames of 16 to 400 bytes with random payloads, so a search from within a frame skips the rest of it */
+std::vector<char> clean_stream(std::mt19937 &rng, size_t size)
+{
+	std::vector<char> stream;
+
+	while (stream.size() < size) {
+		const size_t payload_len = 16 + rng() % 385;
+		stream.insert(stream.end(), {'>', '>', '>', (char)(rng() % 64), 0, (char)(payload_len >> 8),
+					     (char)payload_len, 0, 0
+					    });
+
+		for (size_t i = 0; i < payload_len; ++i) {
+			char byte = rng();
+			// Leave it to the headers to hold markers
+			stream.push_back((byte == '>' && stream.back() == '>') ? '<' : byte);
+		}
+	}
+
+	return stream;
+}
+
+/** Random bytes with one '>' in every gt_every bytes on average and never three in a row */
+std::vector<char> garbage_stream(std::mt19937 &rng, size_t size, unsigned gt_every)
+{
+	std::vector<char> stream;
+
+	while (stream.size() < size) {
+		const bool gt = 0 == rng() % gt_every &&
+				!(stream.size() >= 2 && stream[stream.size() - 1] == '>' && stream[stream.size() - 2] == '>');
+		char byte = rng();
+		stream.push_back(gt ? '>' : (byte == '>' ? '<' : byte));
+	}
+
+	return stream;
+}
+
+struct Scanner {
+	const char *name;
+	size_t (*find)(const char *, size_t);
+};
+
+/** Best of rounds, over windows starting at every offset in steps of stride, each up to BUFFER_SIZE bytes long */
+bool run(const char *stream_name, const std::vector<char> &stream, size_t stride, unsigned rounds,
+	 const std::vector<Scanner> &scanners)
+{
+	using clock = std::chrono::steady_clock;
+	std::vector<size_t> reference;
+	bool match = true;
+
+	printf("%s\n", stream_name);
+
+	for (const Scanner &scanner : scanners) {
+		std::vector<size_t> hits;
+		double best = 0;
+		size_t scanned = 0;
+
+		for (unsigned round = 0; round < rounds; ++round) {
+			hits.clear();
+			scanned = 0;
+			const clock::time_point start = clock::now();
+
+			for (size_t offset = 0; offset + BUFFER_SIZE <= stream.size(); offset += stride) {
+				const size_t hit = scanner.find(stream.data() + offset, BUFFER_SIZE);
+				hits.push_back(hit);
+				scanned += (hit < BUFFER_SIZE) ? hit + 3 : BUFFER_SIZE;
+			}
+
+			const double seconds = std::chrono::duration<double>(clock::now() - start).count();
+
+			if (round == 0 || seconds < best) {
+				best = seconds;
+			}
+		}
+
+		printf("  %-8s %7.2f GB/s  %6.1f ns per search\n", scanner.name, scanned / best / 1e9,
+		       best / hits.size() * 1e9);
+
+		if (reference.empty()) {
+			reference = hits;
+
+		} else {
+			match &= hits == reference;
+		}
+	}
+
+	return match;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+	const unsigned rounds = (argc > 1) ? atoi(argv[1]) : 20;
+	std::mt19937 rng(0x5eed);
+	std::vector<Scanner> scanners = {{"memcmp", find_marker_memcmp}, {"scalar", find_marker_scalar}};
+
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_cpu_init();
+
+	if (__builtin_cpu_supports("sse2")) {
+		scanners.push_back({"sse2", find_marker_sse2});
+	}
+
+	if (__builtin_cpu_supports("avx2")) {
+		scanners.push_back({"avx2", find_marker_avx2});
+	}
+
+#elif defined(__ARM_NEON)
+	scanners.push_back({"neon", find_marker_neon});
+#endif
+
+	printf("marker_bench: %u byte windows, best of %u rounds\n", BUFFER_SIZE, rounds);
+
+	// A search from within a frame, as after a bad CRC or a lost byte, runs to the next header
+	bool match = run("clean stream, from within a frame", clean_stream(rng, 4 << 20), 61, rounds, scanners);
+	match &= run("100% garbage, random bytes", garbage_stream(rng, 4 << 20, 256), 61, rounds, scanners);
+	match &= run("100% garbage, a '>' in every 4 bytes", garbage_stream(rng, 4 << 20, 4), 61, rounds, scanners);
+
+	if (!match) {
+		printf("marker_bench: the scanners found different markers\n");
+		return 1;
+	}
+
+	return 0;
+}
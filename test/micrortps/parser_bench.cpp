@@ -0,0 +1,350 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2020 PX4 Development Team. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+
+/*!
+ * @file parser_bench.cpp
+ * @brief Receive path throughput: decodes the same synthetic stream, a mix of valid frames, noise, spurious markers
+ *        and corrupt CRCs, with the memmove compacting parser the transport had before the receive ring, and with
+ *        the ring through read() and read_batch(). Prints the bytes/s of each, and exits non-zero if they do not
+ *        decode the same frames
+ */
+
+#include "microRTPS_transport.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <random>
+#include <vector>
+
+namespace
+{
+
+constexpr size_t HEADER_LEN = 9; // ">>>", topic ID, seq, payload length and CRC, both big endian
+
+/** Link fed from a stream in memory, at most chunk bytes per node_read() like a UART read or a datagram */
+class StreamNode: public Transport_node
+{
+public:
+	StreamNode(const std::vector<char> &stream, size_t chunk): Transport_node(false), _stream(stream), _chunk(chunk) {}
+
+	bool done() const { return _pos == _stream.size(); }
+	uint16_t crc(const uint8_t *buffer, size_t len) { return crc16(buffer, len); }
+
+	/**
+	 * The parser before the receive buffer: one node_read() and one frame per call, compacting with memmove. Built
+	 * as it was in the transport, out of line and calling the link through the vtable, rather than inlined into the
+	 * loop timing it with the calls to this class devirtualized
+	 */
+	__attribute__((noinline)) ssize_t read_memmove(uint8_t *topic_ID, char out_buffer[], size_t buffer_len,
+			bool bytewise_crc)
+	{
+		StreamNode *link = this;
+		__asm__("" : "+r"(link));
+
+		if (nullptr == out_buffer || nullptr == topic_ID || !link->fds_OK()) {
+			return -1;
+		}
+
+		*topic_ID = 255;
+
+		struct iovec iov = {_linear + _linear_len, sizeof(_linear) - _linear_len};
+		ssize_t len = link->node_read(&iov, 1);
+		_linear_len += len;
+
+		if (_linear_len < HEADER_LEN) {
+			return 0;
+		}
+
+		uint32_t start;
+
+		for (start = 0; start <= _linear_len - HEADER_LEN; ++start) {
+			if ('>' == _linear[start] && 0 == memcmp(_linear + start, ">>>", 3)) {
+				break;
+			}
+		}
+
+		if (start > _linear_len - HEADER_LEN) {
+			memmove(_linear, _linear + start, _linear_len - start);
+			_linear_len -= start;
+			return -1;
+		}
+
+		const uint8_t *header = (const uint8_t *)_linear + start;
+		const uint32_t payload_len = ((uint32_t)header[5] << 8) | header[6];
+
+		if (buffer_len < HEADER_LEN + payload_len) {
+			memmove(_linear, _linear + start + 1, _linear_len - (start + 1));
+			_linear_len -= start + 1;
+			return -EMSGSIZE;
+		}
+
+		if (start + HEADER_LEN + payload_len > _linear_len) {
+			if (start > 0) {
+				memmove(_linear, _linear + start, _linear_len - start);
+				_linear_len -= start;
+			}
+
+			return 0;
+		}
+
+		const uint16_t read_crc = ((uint16_t)header[7] << 8) | header[8];
+		uint16_t calc_crc = 0;
+
+		if (bytewise_crc) {
+			for (uint32_t i = 0; i < payload_len; ++i) {
+				calc_crc = crc16_byte(calc_crc, header[HEADER_LEN + i]);
+			}
+
+		} else {
+			calc_crc = crc16(header + HEADER_LEN, payload_len);
+		}
+
+		if (read_crc != calc_crc) {
+			memmove(_linear, _linear + start + 1, _linear_len - (start + 1));
+			_linear_len -= start + 1;
+			return -1;
+		}
+
+		memmove(out_buffer, _linear + start + HEADER_LEN, payload_len);
+		*topic_ID = header[3];
+		_linear_len -= start + HEADER_LEN + payload_len;
+		memmove(_linear, _linear + start + HEADER_LEN + payload_len, _linear_len);
+		return HEADER_LEN + payload_len;
+	}
+
+protected:
+	ssize_t node_read(const struct iovec *iov, int iovcnt)
+	{
+		size_t len = 0;
+
+		for (int i = 0; i < iovcnt && _pos < _stream.size(); ++i) {
+			size_t n = std::min(iov[i].iov_len, std::min(_chunk - len, _stream.size() - _pos));
+			memcpy(iov[i].iov_base, _stream.data() + _pos, n);
+			_pos += n;
+			len += n;
+		}
+
+		return len;
+	}
+
+	ssize_t node_write(const struct iovec *, int) { return 0; }
+	bool fds_OK() { return true; }
+
+private:
+	const std::vector<char> &_stream;
+	size_t _chunk;
+	size_t _pos = 0;
+	char _linear[BUFFER_SIZE];
+	uint32_t _linear_len = 0;
+};
+
+/**
+ * Frames decoded by a parser, to compare the parsers by: how many, and a checksum of their topics, lengths and first
+ * and last payload bytes. The CRC has checked the rest, and hashing every byte here would weigh more than parsing
+ */
+struct Decoded {
+	size_t frames = 0;
+	uint64_t checksum = 0;
+
+	void add(uint8_t topic_ID, const char *payload, size_t len)
+	{
+		++frames;
+		checksum = checksum * 31 + topic_ID;
+		checksum = checksum * 31 + len;
+		checksum = checksum * 31 + (uint8_t)payload[0];
+		checksum = checksum * 31 + (uint8_t)payload[len - 1];
+	}
+
+	bool operator!=(const Decoded &other) const { return frames != other.frames || checksum != other.checksum; }
+};
+
+/** 80% valid frames of 16 to 400 bytes, 10% with a corrupt payload, 10% noise runs that may hold '>' and ">>>" */
+std::vector<char> make_stream(size_t size)
+{
+	StreamNode node(std::vector<char>(), 1);
+	std::mt19937 rng(0x5eed);
+	std::vector<char> stream;
+	std::vector<uint8_t> payload;
+	uint8_t seq = 0;
+
+	while (stream.size() < size) {
+		const unsigned kind = rng() % 10;
+
+		if (kind < 9) {
+			payload.resize(16 + rng() % 385);
+
+			for (uint8_t &byte : payload) {
+				byte = rng();
+			}
+
+			const uint16_t crc = node.crc(payload.data(), payload.size());
+			const char header[HEADER_LEN] = {'>', '>', '>', (char)(rng() % 64), (char)seq++,
+							 (char)(payload.size() >> 8), (char)payload.size(), (char)(crc >> 8), (char)crc
+							};
+
+			if (kind == 8) {
+				payload[rng() % payload.size()] ^= 1 + rng() % 255;
+			}
+
+			stream.insert(stream.end(), header, header + HEADER_LEN);
+			stream.insert(stream.end(), payload.begin(), payload.end());
+
+		} else {
+			for (unsigned n = 1 + rng() % 64; n > 0; --n) {
+				const unsigned noise = rng() % 32;
+				stream.push_back(noise == 0 ? '>' : (char)rng());
+
+				if (noise == 1) {
+					stream.insert(stream.end(), {'>', '>', '>'});
+				}
+			}
+		}
+	}
+
+	return stream;
+}
+
+/** A parser under test, decoding a whole stream per round */
+struct Parser {
+	const char *name;
+	std::function<void(StreamNode &, Decoded &)> parse;
+	double best_seconds;
+	Decoded decoded;
+};
+
+/**
+ * Best of rounds, as the others mostly measure what else the machine was doing. Each round runs every parser once,
+ * so that a busy spell of the machine slows them all rather than the one that happened to run then
+ */
+void run(const std::vector<char> &stream, size_t chunk, unsigned rounds, std::vector<Parser> &parsers)
+{
+	using clock = std::chrono::steady_clock;
+
+	for (unsigned round = 0; round < rounds; ++round) {
+		for (Parser &parser : parsers) {
+			StreamNode node(stream, chunk);
+			parser.decoded = Decoded();
+			const clock::time_point start = clock::now();
+			parser.parse(node, parser.decoded);
+			const double seconds = std::chrono::duration<double>(clock::now() - start).count();
+
+			if (round == 0 || seconds < parser.best_seconds) {
+				parser.best_seconds = seconds;
+			}
+		}
+	}
+
+	for (const Parser &parser : parsers) {
+		printf("  %-26s %8.1f MB/s  %zu frames\n", parser.name, stream.size() / parser.best_seconds / 1e6,
+		       parser.decoded.frames);
+	}
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+	const unsigned rounds = (argc > 1) ? atoi(argv[1]) : 20;
+	const std::vector<char> stream = make_stream(8 << 20);
+	char out_buffer[BUFFER_SIZE];
+
+	const auto memmove_parser = [&](bool bytewise) {
+		return [&, bytewise](StreamNode & node, Decoded & out) {
+			uint8_t topic_ID;
+
+			for (;;) {
+				const bool drained = node.done();
+				const ssize_t len = node.read_memmove(&topic_ID, out_buffer, sizeof(out_buffer), bytewise);
+
+				if (len > 0) {
+					out.add(topic_ID, out_buffer, len - HEADER_LEN);
+
+				} else if (len == 0 && drained) {
+					break;
+				}
+			}
+		};
+	};
+
+	std::vector<Parser> parsers = {
+		{"memmove, bytewise crc16", memmove_parser(true), 0, {}},
+		{"memmove, current crc16", memmove_parser(false), 0, {}},
+		{
+			"ring, read()", [&](StreamNode & node, Decoded & out) {
+				uint8_t topic_ID;
+
+				for (;;) {
+					const bool drained = node.done();
+					const ssize_t len = node.read(&topic_ID, out_buffer, sizeof(out_buffer));
+
+					if (len > 0) {
+						out.add(topic_ID, out_buffer, len - HEADER_LEN);
+
+					} else if (len == 0 && drained) {
+						break;
+					}
+				}
+			}, 0, {}
+		},
+		{
+			"ring, read_batch()", [&](StreamNode & node, Decoded & out) {
+				char *buffer = out_buffer;
+
+				while (!node.done()) {
+					node.read_batch(buffer, sizeof(out_buffer), [&](uint8_t topic_ID, char *payload, size_t len) {
+						out.add(topic_ID, payload, len);
+					});
+				}
+			}, 0, {}
+		},
+	};
+
+	printf("parser_bench: %zu byte stream, %u rounds\n", stream.size(), rounds);
+
+	for (size_t chunk : {32, 256, BUFFER_SIZE}) {
+		printf("node_read() chunks of %zu bytes\n", chunk);
+		run(stream, chunk, rounds, parsers);
+
+		for (const Parser &parser : parsers) {
+			if (parser.decoded != parsers[0].decoded) {
+				printf("parser_bench: %s decoded different frames\n", parser.name);
+				return 1;
+			}
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,285 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2020 PX4 Development Team. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+/*!
+ * @file participants_bench.cpp
+ * @brief DDS participant cost: creates N participants the way RtpsTopics does, N = 1 being the shared participant and
+ *        N = one per bridged endpoint what the agent ran before. Prints the startup time, the threads and RSS they add
+ *        and the SPDP discovery packets per second seen on the domain 0 multicast group
+ */
+
+#include <fastrtps/config.h>
+#include <fastrtps/Domain.h>
+#include <fastrtps/attributes/ParticipantAttributes.h>
+#include <fastrtps/participant/Participant.h>
+
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <netinet/in.h>
+#include <string>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using namespace eprosima::fastrtps;
+
+namespace
+{
+
+using Clock = std::chrono::steady_clock;
+
+/** Domain 0 SPDP locator, RTPS 9.6.1.4: port 7400 + 250 * domain on the default group */
+const char *const SPDP_GROUP = "239.255.0.1";
+const uint16_t SPDP_PORT = 7400;
+
+/** Value in kB or count of a /proc/self/status field, -1 if missing */
+long proc_status(const char *field)
+{
+	FILE *status = fopen("/proc/self/status", "r");
+
+	if (status == nullptr) {
+		return -1;
+	}
+
+	const size_t length = strlen(field);
+	char line[256];
+	long value = -1;
+
+	while (fgets(line, sizeof(line), status)) {
+		if (strncmp(line, field, length) == 0 && line[length] == ':') {
+			value = atol(line + length + 1);
+			break;
+		}
+	}
+
+	fclose(status);
+	return value;
+}
+
+/** Counts the RTPS packets sent to the SPDP multicast group, by any participant on the host */
+class DiscoveryCounter
+{
+public:
+	DiscoveryCounter()
+	{
+		_fd = socket(AF_INET, SOCK_DGRAM, 0);
+
+		if (_fd < 0) {
+			perror("socket");
+			return;
+		}
+
+		// Fast-RTPS binds the same port with SO_REUSEADDR, every socket bound to it receives the group traffic
+		int reuse = 1;
+		setsockopt(_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+		struct sockaddr_in addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.sin_family = AF_INET;
+		addr.sin_port = htons(SPDP_PORT);
+		addr.sin_addr.s_addr = htonl(INADDR_ANY);
+
+		struct ip_mreq group;
+		group.imr_multiaddr.s_addr = inet_addr(SPDP_GROUP);
+		group.imr_interface.s_addr = htonl(INADDR_ANY);
+
+		struct timeval timeout = {0, 100000};
+
+		if (bind(_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0
+		    || setsockopt(_fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &group, sizeof(group)) < 0
+		    || setsockopt(_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) < 0) {
+			perror("SPDP socket");
+			close(_fd);
+			_fd = -1;
+			return;
+		}
+
+		_thread = std::thread([this] {
+			char packet[65536];
+
+			while (!_stop.load(std::memory_order_relaxed)) {
+				const ssize_t length = recv(_fd, packet, sizeof(packet), 0);
+
+				if (length >= 4 && memcmp(packet, "RTPS", 4) == 0) {
+					_packets.fetch_add(1, std::memory_order_relaxed);
+				}
+			}
+		});
+	}
+
+	~DiscoveryCounter()
+	{
+		_stop.store(true, std::memory_order_relaxed);
+
+		if (_thread.joinable()) {
+			_thread.join();
+		}
+
+		if (_fd >= 0) {
+			close(_fd);
+		}
+	}
+
+	bool ok() const { return _fd >= 0; }
+
+	unsigned long packets() const { return _packets.load(std::memory_order_relaxed); }
+
+private:
+	int _fd{-1};
+	std::thread _thread;
+	std::atomic<bool> _stop{false};
+	std::atomic<unsigned long> _packets{0};
+};
+
+/** Participant attributes as RtpsTopics::createParticipants() sets them */
+Participant *create_participant(size_t index, size_t count)
+{
+	ParticipantAttributes PParam;
+#if FASTRTPS_VERSION_MAJOR < 2
+	PParam.rtps.builtin.domainId = 0;
+#else
+	PParam.domainId = 0;
+#endif
+#if FASTRTPS_VERSION_MAJOR < 1 || (FASTRTPS_VERSION_MAJOR == 1 && (FASTRTPS_VERSION_MINOR < 8 \
+		|| (FASTRTPS_VERSION_MINOR == 8 && FASTRTPS_VERSION_MICRO <= 4)))
+	PParam.rtps.builtin.leaseDuration = c_TimeInfinite;
+#else
+	PParam.rtps.builtin.discovery_config.leaseDuration = c_TimeInfinite;
+#endif
+	std::string nodeName = "micrortps_agent";
+
+	if (count > 1) {
+		nodeName.append("_" + std::to_string(index));
+	}
+
+	PParam.rtps.setName(nodeName.c_str());
+	return Domain::createParticipant(PParam);
+}
+
+/** One participant count, run in its own process so that threads and RSS start from the same baseline */
+int measure(size_t count, unsigned window_s)
+{
+	DiscoveryCounter discovery;
+	const long threads = proc_status("Threads");
+	const long rss = proc_status("VmRSS");
+	std::vector<Participant *> participants;
+
+	const Clock::time_point start = Clock::now();
+
+	for (size_t i = 0; i < count; ++i) {
+		Participant *participant = create_participant(i, count);
+
+		if (participant == nullptr) {
+			fprintf(stderr, "Failed creating participant %zu of %zu\n", i + 1, count);
+			break;
+		}
+
+		participants.push_back(participant);
+	}
+
+	const double startup_ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	const long threads_added = proc_status("Threads") - threads;
+	const long rss_added = proc_status("VmRSS") - rss;
+
+	// Skip the initial announcement burst, then count the steady discovery rate
+	std::this_thread::sleep_for(std::chrono::seconds(1));
+	const unsigned long packets = discovery.packets();
+	std::this_thread::sleep_for(std::chrono::seconds(window_s));
+	const double packets_s = (double)(discovery.packets() - packets) / window_s;
+
+	for (Participant *participant : participants) {
+		Domain::removeParticipant(participant);
+	}
+
+	if (participants.size() != count) {
+		return 1;
+	}
+
+	printf("%12zu  %10.1f  %7ld  %7ld  ", count, startup_ms, threads_added, rss_added);
+
+	if (discovery.ok()) {
+		printf("%14.1f\n", packets_s);
+
+	} else {
+		printf("%14s\n", "-");
+	}
+
+	// The child leaves with _exit(), which does not flush
+	fflush(stdout);
+	return 0;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+	const unsigned window_s = (argc > 1) ? atoi(argv[1]) : 10;
+	std::vector<size_t> counts;
+
+	for (int i = 2; i < argc; ++i) {
+		counts.push_back(atoi(argv[i]));
+	}
+
+	if (counts.empty()) {
+		counts = {1, 16, 100};
+	}
+
+	printf("participants_bench: discovery counted over %u s on %s:%u, packets from any participant on the host\n",
+	       window_s, SPDP_GROUP, SPDP_PORT);
+	printf("participants  startup ms  threads   RSS kB  SPDP packets/s\n");
+	fflush(stdout);
+
+	int failed = 0;
+
+	for (size_t count : counts) {
+		const pid_t pid = fork();
+
+		if (pid == 0) {
+			_exit(measure(count, window_s));
+		}
+
+		int status = 0;
+
+		if (pid < 0 || waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+			failed = 1;
+		}
+	}
+
+	return failed;
+}
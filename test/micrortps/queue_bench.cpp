@@ -0,0 +1,257 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2020 PX4 Development Team. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+
+/*!
+ * @file queue_bench.cpp
+ * @brief Send queue contention: N producer threads, as the DDS listeners, queue topic IDs for one consumer, as the
+ *        sender, through the mutex, condition variable and std::queue the agent had before, and through SendQueue.
+ *        Prints the CPU time producers spend per push, the total throughput and the CPU time per topic of each
+ */
+
+#include "microRTPS_send_queue.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <queue>
+#include <sys/resource.h>
+#include <thread>
+#include <time.h>
+#include <vector>
+
+namespace
+{
+
+using Clock = std::chrono::steady_clock;
+
+/** The queue before SendQueue: every push and pop under one mutex, the consumer woken by notify_one() */
+class LockedQueue
+{
+public:
+	void push(uint8_t topic_ID)
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+		_queue.push(topic_ID);
+		_cv.notify_one();
+	}
+
+	/** false once done() was called and everything was popped */
+	bool pop(uint8_t &topic_ID)
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+
+		while (_queue.empty() && !_done) {
+			_cv.wait(lock);
+		}
+
+		if (_queue.empty()) {
+			return false;
+		}
+
+		topic_ID = _queue.front();
+		_queue.pop();
+		return true;
+	}
+
+	void done()
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+		_done = true;
+		_cv.notify_one();
+	}
+
+private:
+	std::mutex _mutex;
+	std::condition_variable _cv;
+	std::queue<uint8_t> _queue;
+	bool _done = false;
+};
+
+/** SendQueue as the agent uses it: a full queue falls back to mark(), the sender sleeps on wait() */
+class LockFreeQueue
+{
+public:
+	void push(uint8_t topic_ID)
+	{
+		if (!_queue.push(topic_ID)) {
+			_queue.mark(topic_ID);
+			_marked.fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+
+	bool pop(uint8_t &topic_ID)
+	{
+		for (;;) {
+			if (_queue.pop(topic_ID)) {
+				return true;
+			}
+
+			if (_done.load(std::memory_order_acquire) && _queue.empty()) {
+				return false;
+			}
+
+			_queue.wait(100);
+		}
+	}
+
+	void done()
+	{
+		_done.store(true, std::memory_order_release);
+		_queue.wake();
+	}
+
+	unsigned long marked() const { return _marked.load(std::memory_order_relaxed); }
+
+private:
+	SendQueue _queue;
+	std::atomic<bool> _done{false};
+	std::atomic<unsigned long> _marked{0};
+};
+
+double cpu_seconds()
+{
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+/** CPU time of the calling thread, which unlike the wall time leaves out the time it was preempted */
+double thread_cpu_seconds()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+struct Result {
+	double push_ns;     ///< Mean CPU time a producer spends in a push
+	double topics_s;    ///< Topics pushed per second, over all producers
+	double cpu_ns;      ///< CPU time per topic pushed
+	unsigned long popped;
+};
+
+/**
+ * @param paced producers yield after every push, as listeners do other work between samples, so that the consumer
+ *        keeps up instead of the queue filling up, on a single CPU too
+ */
+template <typename Queue>
+Result run(unsigned producers, unsigned pushes, bool paced, Queue &queue)
+{
+	std::vector<std::thread> threads;
+	std::vector<double> push_seconds(producers);
+	std::atomic<bool> go{false};
+	unsigned long popped = 0;
+
+	std::thread consumer([&] {
+		uint8_t topic_ID;
+
+		while (queue.pop(topic_ID)) {
+			++popped;
+		}
+	});
+
+	for (unsigned p = 0; p < producers; ++p) {
+		threads.emplace_back([&, p] {
+			while (!go.load(std::memory_order_acquire)) {
+				std::this_thread::yield();
+			}
+
+			const double start = thread_cpu_seconds();
+
+			double yield_seconds = 0;
+
+			for (unsigned i = 0; i < pushes; ++i) {
+				queue.push((uint8_t)((p * 37 + i) & 63));
+
+				if (paced) {
+					const double yield_start = thread_cpu_seconds();
+					std::this_thread::yield();
+					yield_seconds += thread_cpu_seconds() - yield_start;
+				}
+			}
+
+			push_seconds[p] = thread_cpu_seconds() - start - yield_seconds;
+		});
+	}
+
+	const double cpu_start = cpu_seconds();
+	const Clock::time_point start = Clock::now();
+	go.store(true, std::memory_order_release);
+
+	for (std::thread &thread : threads) {
+		thread.join();
+	}
+
+	queue.done();
+	consumer.join();
+	const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+	const double total = (double)producers * pushes;
+	double push_total = 0;
+
+	for (double s : push_seconds) {
+		push_total += s;
+	}
+
+	return {push_total / total * 1e9, total / seconds, (cpu_seconds() - cpu_start) / total * 1e9, popped};
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+	const unsigned pushes = (argc > 1) ? atoi(argv[1]) : 1000000;
+
+	printf("queue_bench: %u pushes per producer, %u CPUs\n", pushes, std::thread::hardware_concurrency());
+
+	for (bool paced : {false, true}) {
+		printf("%s\nproducers  queue       CPU ns/push  Mtopics/s  CPU ns/topic   popped   marked\n",
+		       paced ? "Producers yielding after each push" : "Producers pushing flat out");
+
+		for (unsigned producers : {1, 2, 4, 8}) {
+			LockedQueue locked;
+			const Result l = run(producers, pushes, paced, locked);
+			printf("%9u  mutex+cv   %11.1f  %9.2f  %12.1f  %7lu  %7s\n", producers, l.push_ns, l.topics_s / 1e6,
+			       l.cpu_ns, l.popped, "-");
+
+			LockFreeQueue lock_free;
+			const Result f = run(producers, pushes, paced, lock_free);
+			printf("%9u  SendQueue  %11.1f  %9.2f  %12.1f  %7lu  %7lu\n", producers, f.push_ns, f.topics_s / 1e6,
+			       f.cpu_ns, f.popped, lock_free.marked());
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,315 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2020 PX4 Development Team. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+
+/*!
+ * @file send_queue_test.cpp
+ * @brief Checks the queues between the subscriber listeners and the sender: FIFO order and the full and empty edges
+ *        of MPSCQueue, the eviction of both SampleRing overflow policies, the dirty bitmap SendQueue falls back to
+ *        once its FIFO is full, and that concurrent producers neither lose nor duplicate an entry. Exits non-zero
+ *        on the first failure
+ */
+
+#include "microRTPS_send_queue.h"
+
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+bool check(bool ok, const char *what)
+{
+	if (!ok) {
+		printf("send_queue: %s\n", what);
+	}
+
+	return ok;
+}
+
+bool test_mpsc_edges()
+{
+	MPSCQueue<int, 8> queue;
+	int value = -1;
+
+	if (!check(queue.empty() && !queue.pop(value), "MPSCQueue: new queue not empty")) {
+		return false;
+	}
+
+	// Several times round, so the cell sequences wrap
+	for (int lap = 0; lap < 3; ++lap) {
+		for (int i = 0; i < 8; ++i) {
+			if (!check(queue.push(lap * 8 + i), "MPSCQueue: push failed before full")) {
+				return false;
+			}
+		}
+
+		if (!check(!queue.push(-1), "MPSCQueue: push succeeded when full")) {
+			return false;
+		}
+
+		for (int i = 0; i < 8; ++i) {
+			if (!check(queue.pop(value) && value == lap * 8 + i, "MPSCQueue: pop out of order")) {
+				return false;
+			}
+		}
+
+		if (!check(queue.empty() && !queue.pop(value), "MPSCQueue: not empty after popping all")) {
+			return false;
+		}
+	}
+
+	// One free cell is enough for the next push
+	for (int i = 0; i < 8; ++i) {
+		queue.push(i);
+	}
+
+	return check(queue.pop(value) && value == 0 && queue.push(8) && !queue.push(9),
+		     "MPSCQueue: pop from full did not free exactly one cell");
+}
+
+bool test_sample_ring(OverflowPolicy policy)
+{
+	SampleRing<int> ring;
+	ring.init(3, policy);
+	const bool drop_oldest = OverflowPolicy::DROP_OLDEST == policy;
+	int value = 0;
+
+	if (!check(ring.depth() == 4, "SampleRing: depth not rounded up to a power of two") ||
+	    !check(ring.empty() && !ring.pop(value), "SampleRing: new ring not empty")) {
+		return false;
+	}
+
+	for (int i = 1; i <= 6; ++i) {
+		value = i;
+		const bool pushed = ring.push(value);
+
+		if (!check(pushed == (i <= 4 || drop_oldest), "SampleRing: push result does not follow the policy")) {
+			return false;
+		}
+	}
+
+	// The oldest policy keeps the last four samples, the newest policy the first four
+	const int first = drop_oldest ? 3 : 1;
+
+	for (int i = first; i < first + 4; ++i) {
+		if (!check(ring.pop(value) && value == i, "SampleRing: wrong sample kept")) {
+			return false;
+		}
+	}
+
+	return check(ring.empty() && !ring.pop(value), "SampleRing: not empty after popping all") &&
+	       check(ring.overflows() == 2, "SampleRing: overflows not counted once per dropped sample");
+}
+
+bool test_sample_ring_single()
+{
+	// The coalescing subscribers' ring, which keeps the latest sample only
+	SampleRing<int> ring;
+	ring.init(1, OverflowPolicy::DROP_OLDEST);
+	int value = 0;
+
+	for (int lap = 0; lap < 3; ++lap) {
+		for (int i = 1; i <= 3; ++i) {
+			value = lap * 3 + i;
+
+			if (!check(ring.push(value), "SampleRing: single sample push failed")) {
+				return false;
+			}
+		}
+
+		if (!check(ring.pop(value) && value == lap * 3 + 3, "SampleRing: single sample ring did not keep the latest") ||
+		    !check(ring.empty() && !ring.pop(value), "SampleRing: single sample ring not empty after popping")) {
+			return false;
+		}
+	}
+
+	return check(ring.depth() == 1 && ring.overflows() == 6, "SampleRing: single sample ring overflows miscounted");
+}
+
+bool test_send_queue_spill()
+{
+	SendQueue queue;
+	uint8_t topic_ID = 0;
+
+	if (!check(queue.empty() && !queue.pop(topic_ID), "SendQueue: new queue not empty")) {
+		return false;
+	}
+
+	// Fill the FIFO, then fall back to the bitmap as the subscribers do, marking some topics several times
+	for (unsigned i = 0; i < 1024; ++i) {
+		if (!check(queue.push((uint8_t)(i % 200)), "SendQueue: push failed before the FIFO was full")) {
+			return false;
+		}
+	}
+
+	for (uint8_t topic : {200, 7, 255, 7, 64, 200}) {
+		if (!check(!queue.push(topic), "SendQueue: push succeeded with the FIFO full")) {
+			return false;
+		}
+
+		queue.mark(topic);
+	}
+
+	// Queued samples first, in order, then each marked topic once, lowest topic ID first
+	for (unsigned i = 0; i < 1024; ++i) {
+		if (!check(queue.pop(topic_ID) && topic_ID == i % 200, "SendQueue: FIFO drained out of order")) {
+			return false;
+		}
+	}
+
+	for (uint8_t topic : {7, 64, 200, 255}) {
+		if (!check(queue.pop(topic_ID) && topic_ID == topic, "SendQueue: marked topics drained wrongly")) {
+			return false;
+		}
+	}
+
+	if (!check(queue.empty() && !queue.pop(topic_ID), "SendQueue: not empty after draining")) {
+		return false;
+	}
+
+	// The FIFO takes samples again once drained
+	return check(queue.push(1) && queue.pop(topic_ID) && topic_ID == 1, "SendQueue: push failed after draining");
+}
+
+bool test_mpsc_stress()
+{
+	constexpr unsigned PRODUCERS = 4;
+	constexpr uint32_t PER_PRODUCER = 200000;
+	MPSCQueue<uint32_t, 1024> queue;
+	std::vector<std::thread> producers;
+
+	for (uint32_t p = 0; p < PRODUCERS; ++p) {
+		producers.emplace_back([&queue, p]() {
+			for (uint32_t i = 0; i < PER_PRODUCER; ++i) {
+				while (!queue.push(p << 24 | i)) {
+					std::this_thread::yield();
+				}
+			}
+		});
+	}
+
+	// Each producer's values must come out once each and in the order it pushed them
+	std::vector<uint32_t> next(PRODUCERS, 0);
+	bool ok = true;
+
+	for (uint32_t received = 0; received < PRODUCERS * PER_PRODUCER;) {
+		uint32_t value;
+
+		if (!queue.pop(value)) {
+			std::this_thread::yield();
+			continue;
+		}
+
+		const uint32_t p = value >> 24;
+
+		if (p >= PRODUCERS || (value & 0xffffff) != next[p]) {
+			ok = false;
+
+		} else {
+			++next[p];
+		}
+
+		++received;
+	}
+
+	for (std::thread &producer : producers) {
+		producer.join();
+	}
+
+	uint32_t value;
+	return check(ok, "MPSCQueue: a producer's value was lost, duplicated or reordered") &&
+	       check(!queue.pop(value), "MPSCQueue: values left after every push was received");
+}
+
+bool test_send_queue_stress()
+{
+	constexpr unsigned PRODUCERS = 4;
+	constexpr unsigned PER_PRODUCER = 100000;
+	SendQueue queue;
+	std::vector<std::thread> producers;
+
+	// Each producer owns 64 topic IDs and pushes each the same number of times
+	for (unsigned p = 0; p < PRODUCERS; ++p) {
+		producers.emplace_back([&queue, p]() {
+			for (unsigned i = 0; i < PER_PRODUCER; ++i) {
+				while (!queue.push((uint8_t)(p * 64 + i % 64))) {
+					std::this_thread::yield();
+				}
+			}
+		});
+	}
+
+	std::vector<unsigned> count(256, 0);
+
+	for (unsigned received = 0; received < PRODUCERS * PER_PRODUCER;) {
+		uint8_t topic_ID;
+
+		if (queue.pop(topic_ID)) {
+			++count[topic_ID];
+			++received;
+
+		} else {
+			queue.wait(10);
+		}
+	}
+
+	for (std::thread &producer : producers) {
+		producer.join();
+	}
+
+	bool ok = true;
+
+	for (unsigned topic = 0; topic < 256; ++topic) {
+		ok &= count[topic] == ((topic < PRODUCERS * 64) ? PER_PRODUCER / 64 + (topic % 64 < PER_PRODUCER % 64) : 0);
+	}
+
+	return check(ok, "SendQueue: a topic was lost or duplicated") && check(queue.empty(), "SendQueue: not empty");
+}
+
+} // namespace
+
+int main()
+{
+	const bool ok = test_mpsc_edges() && test_sample_ring(OverflowPolicy::DROP_OLDEST) &&
+			test_sample_ring(OverflowPolicy::DROP_NEWEST) && test_sample_ring_single() && test_send_queue_spill() &&
+			test_mpsc_stress() && test_send_queue_stress();
+
+	if (!ok) {
+		return 1;
+	}
+
+	printf("send_queue: MPSCQueue, SampleRing and SendQueue pass\n");
+	return 0;
+}
@@ -0,0 +1,162 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2020 PX4 Development Team. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+
+/*!
+ * @file udp_bench.cpp
+ * @brief UDP batching over loopback: sends bursts of small frames through one UDP_node and drains them from
+ *        another, with recvmmsg/sendmmsg batches of 1 (one syscall per datagram), 16 and 64. Prints the syscalls
+ *        and CPU time per frame of each batch size, and exits non-zero if frames are lost
+ */
+
+#include "microRTPS_transport.h"
+
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <initializer_list>
+#include <string>
+#include <sys/resource.h>
+
+namespace
+{
+
+constexpr uint16_t PORT_A = 15500; // Sender to receiver
+constexpr uint16_t PORT_B = 15501; // Unused way back
+constexpr size_t PAYLOAD_LEN = 64;
+constexpr unsigned BURST = 128;   // Frames in flight, well within the default socket receive buffer
+
+/** UDP_node counting its syscalls: every send and receive of a batch of 1, and every sendmmsg and recvmmsg */
+class CountingUDPNode: public UDP_node
+{
+public:
+	CountingUDPNode(uint16_t port_recv, uint16_t port_send, uint32_t batch):
+		UDP_node("127.0.0.1", port_recv, port_send, false, batch, 1000000) {}
+
+	unsigned long rx_syscalls = 0;
+	unsigned long tx_syscalls = 0;
+
+protected:
+	ssize_t node_read(const struct iovec *iov, int iovcnt)
+	{
+		if (nullptr == rx_msgs || rx_msg_pos >= rx_msg_count) {
+			++rx_syscalls;
+		}
+
+		return UDP_node::node_read(iov, iovcnt);
+	}
+
+	ssize_t node_write(const struct iovec *iov, int iovcnt)
+	{
+		if (nullptr == tx_msgs) {
+			++tx_syscalls;
+		}
+
+		return UDP_node::node_write(iov, iovcnt);
+	}
+
+	ssize_t node_flush()
+	{
+		if (0 < tx_msg_count) {
+			++tx_syscalls;
+		}
+
+		return UDP_node::node_flush();
+	}
+};
+
+double cpu_seconds()
+{
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+	const unsigned frames = (argc > 1) ? atoi(argv[1]) : 200000;
+	char payload[PAYLOAD_LEN] = {};
+	char in_buffer[BUFFER_SIZE];
+
+	std::string results;
+
+	for (uint32_t batch : {1, 16, 64}) {
+		CountingUDPNode sender(PORT_B, PORT_A, batch);
+		CountingUDPNode receiver(PORT_A, PORT_B, batch);
+
+		if (0 > receiver.init() || 0 > sender.init()) {
+			printf("udp_bench: could not open the loopback sockets (%d)\n", errno);
+			return 1;
+		}
+
+		receiver.set_rx_nonblocking(true);
+		unsigned received = 0;
+		const double cpu_start = cpu_seconds();
+		const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+		for (unsigned sent = 0; sent < frames;) {
+			for (unsigned i = 0; i < BURST && sent < frames; ++i, ++sent) {
+				memcpy(payload, &sent, sizeof(sent));
+				sender.write_payload(1, payload, sizeof(payload));
+			}
+
+			sender.flush();
+
+			// Loopback delivers on send, so what is not there once the socket is drained was lost
+			char *buffer = in_buffer;
+
+			while (0 <= receiver.read_batch(buffer, sizeof(in_buffer), [&](uint8_t, char *, size_t) { ++received; })) {
+			}
+		}
+
+		const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		const double cpu = cpu_seconds() - cpu_start;
+		char row[128];
+		snprintf(row, sizeof(row), "  %5u  %8.0f  %19.3f  %19.3f  %12.2f\n", batch, frames / seconds,
+			 (double)sender.tx_syscalls / frames, (double)receiver.rx_syscalls / frames, cpu / frames * 1e6);
+		results += row;
+
+		if (received != frames) {
+			printf("udp_bench: %u of %u frames received\n", received, frames);
+			return 1;
+		}
+	}
+
+	// After the nodes are gone, so that their logs do not break up the table
+	printf("udp_bench: %u frames of %zu payload bytes over loopback, in bursts of %u\n", frames, PAYLOAD_LEN, BURST);
+	printf("  batch  frames/s  send syscalls/frame  recv syscalls/frame  CPU us/frame\n%s", results.c_str());
+	return 0;
+}
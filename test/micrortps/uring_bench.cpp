@@ -0,0 +1,249 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2020 PX4 Development Team. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+
+/*!
+ * @file uring_bench.cpp
+ * @brief UART over a PTY pair, the poll based UART_node against UART_uring_node: the PTY master plays the client,
+ *        one frame at a time each way. Prints the percentiles of the receive latency, of the time the sender is
+ *        blocked in write_payload() and of the send latency, and the CPU time per round trip of each. Exits non-zero
+ *        if a transport cannot be set up or loses a frame
+ */
+
+#include "microRTPS_transport.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <memory>
+#include <string>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <vector>
+
+namespace
+{
+
+using Clock = std::chrono::steady_clock;
+
+constexpr size_t PAYLOAD_LEN = 64;
+
+/** Encodes frames as the client would send them, for the PTY master to write */
+class FrameEncoder: public Transport_node
+{
+public:
+	FrameEncoder(): Transport_node(false) {}
+
+	std::vector<char> frame;
+
+protected:
+	ssize_t node_read(const struct iovec *, int) { return 0; }
+	ssize_t node_write(const struct iovec *iov, int iovcnt)
+	{
+		frame.clear();
+
+		for (int i = 0; i < iovcnt; ++i) {
+			frame.insert(frame.end(), (char *)iov[i].iov_base, (char *)iov[i].iov_base + iov[i].iov_len);
+		}
+
+		return frame.size();
+	}
+	bool fds_OK() { return true; }
+};
+
+double cpu_seconds()
+{
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+double us(Clock::duration duration) { return std::chrono::duration<double, std::micro>(duration).count(); }
+
+std::string percentiles(std::vector<double> &samples)
+{
+	char text[64];
+	std::sort(samples.begin(), samples.end());
+	snprintf(text, sizeof(text), "%7.1f %7.1f %8.1f", samples[samples.size() / 2], samples[samples.size() * 99 / 100],
+		 samples.back());
+	return text;
+}
+
+/** Round trips through node, whose PTY master is master: a frame written to the master, read by the node, then a frame
+    written by the node, read from the master. Appends a result row, false on a failure */
+bool run(const char *name, Transport_node &node, int master, unsigned round_trips, std::string &results)
+{
+	FrameEncoder encoder;
+	char payload[PAYLOAD_LEN] = {};
+	char in_buffer[BUFFER_SIZE];
+	char out_buffer[BUFFER_SIZE];
+	std::vector<double> rx_latency, tx_call, tx_latency;
+	double cpu = 0;
+
+	encoder.write_payload(1, payload, sizeof(payload));
+	const std::vector<char> frame = encoder.frame;
+
+	// The first round trips warm up the page cache, the rings and the PTY buffers, and are left out
+	for (unsigned i = 0; i < round_trips + 100; ++i) {
+		const double cpu_start = cpu_seconds();
+		const Clock::time_point written = Clock::now();
+
+		if ((ssize_t)frame.size() != write(master, frame.data(), frame.size())) {
+			printf("uring_bench: %s: PTY master write failed (%d)\n", name, errno);
+			return false;
+		}
+
+		char *buffer = in_buffer;
+		ssize_t frames = 0;
+
+		for (unsigned reads = 0; frames == 0 && reads < 100; ++reads) {
+			frames = node.read_batch(buffer, sizeof(in_buffer), [](uint8_t, char *, size_t) {});
+		}
+
+		const Clock::time_point received = Clock::now();
+
+		if (frames != 1) {
+			printf("uring_bench: %s: frame not received (%zd, %d)\n", name, frames, errno);
+			return false;
+		}
+
+		// The sender flushes once out of messages, after the call it is blocked in
+		const bool written_ok = 0 <= node.write_payload(1, payload, sizeof(payload));
+		const Clock::time_point sent = Clock::now();
+
+		if (!written_ok || 0 > node.flush()) {
+			printf("uring_bench: %s: write failed (%d)\n", name, errno);
+			return false;
+		}
+
+		size_t got = 0;
+
+		while (got < frame.size()) {
+			ssize_t len = read(master, out_buffer + got, sizeof(out_buffer) - got);
+
+			if (len <= 0) {
+				printf("uring_bench: %s: PTY master read failed (%d)\n", name, errno);
+				return false;
+			}
+
+			got += len;
+		}
+
+		const Clock::time_point delivered = Clock::now();
+
+		if (i >= 100) {
+			cpu += cpu_seconds() - cpu_start;
+			rx_latency.push_back(us(received - written));
+			tx_call.push_back(us(sent - received));
+			tx_latency.push_back(us(delivered - received));
+		}
+	}
+
+	char row[64];
+	snprintf(row, sizeof(row), "%-9s", name);
+	results += std::string(row) + "  " + percentiles(rx_latency) + "  " + percentiles(tx_call) + "  " +
+		   percentiles(tx_latency);
+	snprintf(row, sizeof(row), "  %6.1f\n", cpu / round_trips * 1e6);
+	results += row;
+	return true;
+}
+
+/** PTY pair for a node: the master fd, and the slave name for the node to open */
+int open_pty(std::string &slave)
+{
+	int master = posix_openpt(O_RDWR | O_NOCTTY);
+
+	if (0 > master || 0 != grantpt(master) || 0 != unlockpt(master) || nullptr == ptsname(master)) {
+		return -1;
+	}
+
+	slave = ptsname(master);
+	return master;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+	const unsigned round_trips = (argc > 1) ? atoi(argv[1]) : 20000;
+	const uint32_t depth = (argc > 2) ? atoi(argv[2]) : 8;
+	std::string results;
+
+	for (bool uring : {false, true}) {
+		std::string slave;
+		const int master = open_pty(slave);
+
+		if (0 > master) {
+			printf("uring_bench: could not open a PTY pair (%d)\n", errno);
+			return 1;
+		}
+
+		std::unique_ptr<UART_node> node;
+#ifdef MICRORTPS_IO_URING
+
+		if (uring) {
+			node.reset(new UART_uring_node(slave.c_str(), 460800, 100, false, false, false, depth));
+		}
+
+#endif /* MICRORTPS_IO_URING */
+
+		if (!uring) {
+			node.reset(new UART_node(slave.c_str(), 460800, 100, false, false, false));
+		}
+
+		if (0 > node->init()) {
+			printf("uring_bench: %s: could not set the transport up on %s (%d)\n", uring ? "io_uring" : "poll",
+			       slave.c_str(), errno);
+			return 1;
+		}
+
+		const bool ok = run(uring ? "io_uring" : "poll", *node, master, round_trips, results);
+		node.reset();
+		close(master);
+
+		if (!ok) {
+			return 1;
+		}
+	}
+
+	// After the nodes are gone, so that their logs do not break up the table
+	printf("uring_bench: %u round trips of %zu byte payloads over a PTY pair, io_uring depth %u\n", round_trips,
+	       PAYLOAD_LEN, depth);
+	printf("           receive latency us        send call us              send delivered us         CPU us\n"
+	       "               p50     p99      max      p50     p99      max      p50     p99      max  per trip\n%s",
+	       results.c_str());
+	return 0;
+}